@@ -0,0 +1,258 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+#include "bignum.h"
+
+// Operands with at most this many limbs are multiplied by the
+// schoolbook method; above it Karatsuba wins.
+#define KARATSUBA_THRESHOLD 32
+
+// Make sure 'x' has room for at least 'n' limbs.
+static int reserve(struct bignum *x, size_t n) {
+  if (x->cap >= n) {
+    return 0;
+  }
+  size_t cap = x->cap ? x->cap : 4;
+  while (cap < n) {
+    cap *= 2;
+  }
+  uint32_t *limbs = realloc(x->limbs, sizeof(uint32_t) * cap);
+  if (!limbs) {
+    return -1;
+  }
+  x->limbs = limbs;
+  x->cap = cap;
+  return 0;
+}
+
+// Drop leading zero limbs.
+static size_t normalized_len(const uint32_t *limbs, size_t len) {
+  while (len > 0 && limbs[len-1] == 0) {
+    len--;
+  }
+  return len;
+}
+
+// r[0..an) = a + b where an >= bn.  Returns the carry out.
+static uint32_t add_n(uint32_t *r, const uint32_t *a, size_t an,
+                      const uint32_t *b, size_t bn) {
+  uint32_t carry = 0;
+  for (size_t i = 0; i < an; i++) {
+    uint32_t s = a[i] + (i < bn ? b[i] : 0) + carry;
+    carry = s >= BIGNUM_BASE;
+    r[i] = carry ? s - BIGNUM_BASE : s;
+  }
+  return carry;
+}
+
+// r[0..rn) += a[0..an), where the result is known to fit.
+static void add_into(uint32_t *r, size_t rn, const uint32_t *a, size_t an) {
+  uint32_t carry = 0;
+  size_t i;
+  for (i = 0; i < an; i++) {
+    uint32_t s = r[i] + a[i] + carry;
+    carry = s >= BIGNUM_BASE;
+    r[i] = carry ? s - BIGNUM_BASE : s;
+  }
+  for (; carry && i < rn; i++) {
+    carry = ++r[i] == BIGNUM_BASE;
+    if (carry) {
+      r[i] = 0;
+    }
+  }
+  assert(carry == 0);
+}
+
+// r[0..rn) -= a[0..an), where r >= a.
+static void sub_into(uint32_t *r, size_t rn, const uint32_t *a, size_t an) {
+  uint32_t borrow = 0;
+  size_t i;
+  for (i = 0; i < an; i++) {
+    uint32_t d = a[i] + borrow;
+    borrow = r[i] < d;
+    r[i] = borrow ? r[i] + BIGNUM_BASE - d : r[i] - d;
+  }
+  for (; borrow && i < rn; i++) {
+    borrow = r[i] == 0;
+    r[i] = borrow ? BIGNUM_BASE - 1 : r[i] - 1;
+  }
+  assert(borrow == 0);
+}
+
+// r[0..an+bn) = a * b by the schoolbook method.
+static void mul_basic(uint32_t *r, const uint32_t *a, size_t an,
+                      const uint32_t *b, size_t bn) {
+  memset(r, 0, sizeof(uint32_t) * (an + bn));
+  for (size_t i = 0; i < an; i++) {
+    uint64_t ai = a[i];
+    if (ai == 0) {
+      continue;
+    }
+    uint64_t carry = 0;
+    for (size_t j = 0; j < bn; j++) {
+      uint64_t t = ai * b[j] + r[i+j] + carry;
+      r[i+j] = (uint32_t)(t % BIGNUM_BASE);
+      carry = t / BIGNUM_BASE;
+    }
+    r[i+bn] = (uint32_t)carry;
+  }
+}
+
+// Scratch limbs needed by karatsuba() for operands of 'n' limbs.
+static size_t karatsuba_scratch(size_t n) {
+  size_t total = 0;
+  while (n > KARATSUBA_THRESHOLD) {
+    size_t h = n - n/2;
+    total += 4*h + 4;
+    n = h + 1;
+  }
+  return total;
+}
+
+// r[0..2n) = a[0..n) * b[0..n).  Splits a = a1*B^m + a0 (likewise b)
+// and uses a*b = z2*B^2m + (z1 - z2 - z0)*B^m + z0 with
+// z1 = (a0+a1)*(b0+b1), so three half-size products instead of four.
+static void karatsuba(uint32_t *r, const uint32_t *a, const uint32_t *b,
+                      size_t n, uint32_t *scratch) {
+  if (n <= KARATSUBA_THRESHOLD) {
+    mul_basic(r, a, n, b, n);
+    return;
+  }
+  size_t m = n/2;
+  size_t h = n - m;
+  uint32_t *sa = scratch;
+  uint32_t *sb = sa + h + 1;
+  uint32_t *z1 = sb + h + 1;
+  uint32_t *next = z1 + 2*h + 2;
+
+  karatsuba(r, a, b, m, next);                // z0 -> r[0..2m)
+  karatsuba(r + 2*m, a + m, b + m, h, next);  // z2 -> r[2m..2n)
+
+  sa[h] = add_n(sa, a + m, h, a, m);
+  sb[h] = add_n(sb, b + m, h, b, m);
+  karatsuba(z1, sa, sb, h + 1, next);
+  sub_into(z1, 2*h + 2, r, 2*m);
+  sub_into(z1, 2*h + 2, r + 2*m, 2*h);
+  add_into(r + m, 2*n - m, z1, normalized_len(z1, 2*h + 2));
+}
+
+int bignum_init(struct bignum *x, uint32_t value) {
+  x->limbs = NULL;
+  x->len = 0;
+  x->cap = 0;
+  if (reserve(x, 2) != 0) {
+    return -1;
+  }
+  x->limbs[0] = value % BIGNUM_BASE;
+  x->limbs[1] = value / BIGNUM_BASE;
+  x->len = normalized_len(x->limbs, 2);
+  return 0;
+}
+
+void bignum_free(struct bignum *x) {
+  free(x->limbs);
+  x->limbs = NULL;
+  x->len = 0;
+  x->cap = 0;
+}
+
+int bignum_add(struct bignum *r, const struct bignum *a, const struct bignum *b) {
+  if (a->len < b->len) {
+    const struct bignum *t = a;
+    a = b;
+    b = t;
+  }
+  size_t an = a->len, bn = b->len;
+  if (reserve(r, an + 1) != 0) {
+    return -1;
+  }
+  // Limb i is only written after a[i] and b[i] are read, so aliasing
+  // is harmless.
+  r->limbs[an] = add_n(r->limbs, a->limbs, an, b->limbs, bn);
+  r->len = normalized_len(r->limbs, an + 1);
+  return 0;
+}
+
+int bignum_sub(struct bignum *r, const struct bignum *a, const struct bignum *b) {
+  assert(a->len >= b->len);
+  assert(r != b || r == a);
+  size_t an = a->len;
+  if (reserve(r, an) != 0) {
+    return -1;
+  }
+  if (r != a) {
+    memcpy(r->limbs, a->limbs, sizeof(uint32_t) * an);
+  }
+  sub_into(r->limbs, an, b->limbs, b->len);
+  r->len = normalized_len(r->limbs, an);
+  return 0;
+}
+
+int bignum_mul(struct bignum *r, const struct bignum *a, const struct bignum *b) {
+  size_t an = a->len, bn = b->len;
+  if (an == 0 || bn == 0) {
+    r->len = 0;
+    return 0;
+  }
+  size_t n = an > bn ? an : bn;
+  size_t small = an < bn ? an : bn;
+  uint32_t *prod;
+
+  if (small <= KARATSUBA_THRESHOLD) {
+    prod = malloc(sizeof(uint32_t) * (an + bn));
+    if (!prod) {
+      return -1;
+    }
+    mul_basic(prod, a->limbs, an, b->limbs, bn);
+  } else {
+    // Pad both operands to 'n' limbs so the recursion stays balanced
+    size_t scratch = karatsuba_scratch(n);
+    uint32_t *buf = calloc(4*n + scratch, sizeof(uint32_t));
+    if (!buf) {
+      return -1;
+    }
+    uint32_t *pa = buf, *pb = buf + n;
+    prod = buf + 2*n;
+    memcpy(pa, a->limbs, sizeof(uint32_t) * an);
+    memcpy(pb, b->limbs, sizeof(uint32_t) * bn);
+    karatsuba(prod, pa, pb, n, prod + 2*n);
+    // Move the product to the front so 'buf' can become r's storage
+    memmove(buf, prod, sizeof(uint32_t) * 2*n);
+    prod = buf;
+  }
+
+  free(r->limbs);
+  r->limbs = prod;
+  r->cap = an + bn;
+  r->len = normalized_len(prod, an + bn);
+  return 0;
+}
+
+char *bignum_to_string(const struct bignum *x, size_t *len) {
+  if (x->len == 0) {
+    if (len) {
+      *len = 1;
+    }
+    return strdup("0");
+  }
+  char *str = malloc(x->len * BIGNUM_BASE_DIGITS + 1);
+  if (!str) {
+    return NULL;
+  }
+  // The top limb has no leading zeros; every other limb is padded
+  size_t pos = (size_t)sprintf(str, "%u", x->limbs[x->len-1]);
+  for (size_t i = x->len - 1; i-- > 0; ) {
+    uint32_t v = x->limbs[i];
+    for (int d = BIGNUM_BASE_DIGITS - 1; d >= 0; d--) {
+      str[pos + (size_t)d] = (char)('0' + v % 10);
+      v /= 10;
+    }
+    pos += BIGNUM_BASE_DIGITS;
+  }
+  str[pos] = '\0';
+  if (len) {
+    *len = pos;
+  }
+  return str;
+}
@@ -0,0 +1,42 @@
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Base of a single limb.  Using a power of ten makes conversion to
+// decimal a simple walk over the limbs.
+#define BIGNUM_BASE 1000000000u
+#define BIGNUM_BASE_DIGITS 9
+
+// Arbitrary-precision natural number, stored as little-endian limbs
+// in base BIGNUM_BASE.  There are never leading zero limbs, so zero
+// has 'len' == 0.
+struct bignum {
+  uint32_t *limbs;
+  size_t len;
+  size_t cap;
+};
+
+// Initialise 'x' to the given value.  Returns non-zero on error.
+int bignum_init(struct bignum *x, uint32_t value);
+
+// Release the memory held by 'x'.
+void bignum_free(struct bignum *x);
+
+// r = a + b.  'r' may alias 'a' or 'b'.  Returns non-zero on error.
+int bignum_add(struct bignum *r, const struct bignum *a, const struct bignum *b);
+
+// r = a - b, where a >= b.  'r' may alias 'a' (but not 'b' alone).  Returns
+// non-zero on error.
+int bignum_sub(struct bignum *r, const struct bignum *a, const struct bignum *b);
+
+// r = a * b, using Karatsuba multiplication for large operands.  'r'
+// may alias 'a' or 'b'.  Returns non-zero on error.
+int bignum_mul(struct bignum *r, const struct bignum *a, const struct bignum *b);
+
+// Return a newly allocated decimal representation of 'x', storing its
+// length in '*len' (if non-NULL).  Returns NULL on error.
+char *bignum_to_string(const struct bignum *x, size_t *len);
+
+#endif
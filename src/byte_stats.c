@@ -0,0 +1,103 @@
+#include <string.h>
+#include <math.h>
+#include "byte_stats.h"
+
+// Number of interleaved count tables.  Byte i of each 8-byte word goes
+// to table i % TABLES, so a run of equal bytes increments different
+// counters and the increments can proceed in parallel.
+#define TABLES 4
+
+// 32-bit counters are faster to update; flush them to the 64-bit
+// totals before they could overflow.
+#define FLUSH_BYTES ((size_t)1 << 30)
+
+static void count_block(uint64_t counts[256], const unsigned char *buf, size_t len) {
+  uint32_t tables[TABLES][256];
+  memset(tables, 0, sizeof tables);
+
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, buf + i, sizeof w);
+    tables[0][(uint8_t)(w      )]++;
+    tables[1][(uint8_t)(w >>  8)]++;
+    tables[2][(uint8_t)(w >> 16)]++;
+    tables[3][(uint8_t)(w >> 24)]++;
+    tables[0][(uint8_t)(w >> 32)]++;
+    tables[1][(uint8_t)(w >> 40)]++;
+    tables[2][(uint8_t)(w >> 48)]++;
+    tables[3][(uint8_t)(w >> 56)]++;
+  }
+  for (; i < len; i++) {
+    tables[0][buf[i]]++;
+  }
+
+  for (int v = 0; v < 256; v++) {
+    counts[v] += (uint64_t)tables[0][v] + tables[1][v] + tables[2][v] + tables[3][v];
+  }
+}
+
+void byte_stats_update(struct byte_stats *stats, const unsigned char *buf, size_t len) {
+  while (len > 0) {
+    size_t n = len < FLUSH_BYTES ? len : FLUSH_BYTES;
+    count_block(stats->counts, buf, n);
+    buf += n;
+    len -= n;
+  }
+}
+
+void byte_stats_merge(struct byte_stats *from, struct byte_stats *to) {
+  for (int v = 0; v < 256; v++) {
+    to->counts[v] += from->counts[v];
+    from->counts[v] = 0;
+  }
+}
+
+void byte_stats_bits(const struct byte_stats *stats, int histogram[8]) {
+  for (int i = 0; i < 8; i++) {
+    uint64_t n = 0;
+    for (int v = 0; v < 256; v++) {
+      if (v & (1<<i)) {
+        n += stats->counts[v];
+      }
+    }
+    histogram[i] += (int)n;
+  }
+}
+
+uint64_t byte_stats_total(const struct byte_stats *stats) {
+  uint64_t total = 0;
+  for (int v = 0; v < 256; v++) {
+    total += stats->counts[v];
+  }
+  return total;
+}
+
+double byte_stats_entropy(const struct byte_stats *stats) {
+  uint64_t total = byte_stats_total(stats);
+  if (total == 0) {
+    return 0.0;
+  }
+  double h = 0.0;
+  for (int v = 0; v < 256; v++) {
+    if (stats->counts[v]) {
+      double p = stats->counts[v] / (double)total;
+      h -= p * log2(p);
+    }
+  }
+  return h;
+}
+
+double byte_stats_nul_ratio(const struct byte_stats *stats) {
+  uint64_t total = byte_stats_total(stats);
+  return total ? stats->counts[0] / (double)total : 0.0;
+}
+
+double byte_stats_non_ascii_ratio(const struct byte_stats *stats) {
+  uint64_t total = byte_stats_total(stats);
+  uint64_t high = 0;
+  for (int v = 128; v < 256; v++) {
+    high += stats->counts[v];
+  }
+  return total ? high / (double)total : 0.0;
+}
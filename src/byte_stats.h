@@ -0,0 +1,39 @@
+#ifndef BYTE_STATS_H
+#define BYTE_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Everything fhistogram learns from one pass over some bytes.  The
+// 8-bit histogram, entropy and ratios are all derived from the
+// byte-value counts, so only these need to be gathered.
+struct byte_stats {
+  uint64_t counts[256];    // Occurrences of each byte value
+};
+
+// Add the bytes of 'buf' to 'stats'.  Counting uses several
+// interleaved tables so consecutive equal bytes do not stall on the
+// same counter.
+void byte_stats_update(struct byte_stats *stats, const unsigned char *buf, size_t len);
+
+// Add 'from' into 'to', setting 'from' to zero in the process (like
+// merge_histogram()).
+void byte_stats_merge(struct byte_stats *from, struct byte_stats *to);
+
+// Add the per-bit counts implied by 'stats' to an 8-bit histogram as
+// used by histogram.h.
+void byte_stats_bits(const struct byte_stats *stats, int histogram[8]);
+
+// Total number of bytes counted.
+uint64_t byte_stats_total(const struct byte_stats *stats);
+
+// Shannon entropy in bits per byte (0 to 8).
+double byte_stats_entropy(const struct byte_stats *stats);
+
+// Fraction of bytes that are NUL.
+double byte_stats_nul_ratio(const struct byte_stats *stats);
+
+// Fraction of bytes outside 7-bit ASCII.
+double byte_stats_non_ascii_ratio(const struct byte_stats *stats);
+
+#endif
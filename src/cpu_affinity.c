@@ -0,0 +1,282 @@
+// Setting _GNU_SOURCE is necessary for the CPU_* macros and
+// pthread_attr_setaffinity_np().
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include "cpu_affinity.h"
+
+// Read the first line of a small (sysfs/cgroupfs) file into 'buf'.
+// Returns non-zero if the file could not be read.
+static int read_line(const char *path, char *buf, size_t size) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    return -1;
+  }
+  char *ok = fgets(buf, (int)size, f);
+  fclose(f);
+  return ok ? 0 : -1;
+}
+
+// Read an integer from a sysfs file, or return 'fallback'.
+static long read_long(const char *path, long fallback) {
+  char buf[64];
+  if (read_line(path, buf, sizeof buf) != 0) {
+    return fallback;
+  }
+  char *end;
+  errno = 0;
+  long v = strtol(buf, &end, 10);
+  return (errno || end == buf) ? fallback : v;
+}
+
+// CPU limit implied by a quota/period pair, rounded up.  A
+// non-positive quota means "unlimited".
+static int quota_cpus(long quota, long period) {
+  if (quota <= 0 || period <= 0) {
+    return INT_MAX;
+  }
+  long n = (quota + period - 1) / period;
+  return n < 1 ? 1 : (n > INT_MAX ? INT_MAX : (int)n);
+}
+
+// cgroup v2: "cpu.max" holds "<quota|max> <period>".
+static int cgroup2_cpus(const char *dir) {
+  char path[PATH_MAX], buf[128];
+  snprintf(path, sizeof path, "/sys/fs/cgroup%s/cpu.max", dir);
+  if (read_line(path, buf, sizeof buf) != 0 || strncmp(buf, "max", 3) == 0) {
+    return INT_MAX;
+  }
+  long quota, period;
+  if (sscanf(buf, "%ld %ld", &quota, &period) != 2) {
+    return INT_MAX;
+  }
+  return quota_cpus(quota, period);
+}
+
+// cgroup v1: separate "cpu.cfs_quota_us" and "cpu.cfs_period_us".
+static int cgroup1_cpus(const char *mount, const char *dir) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof path, "/sys/fs/cgroup/%s%s/cpu.cfs_quota_us", mount, dir);
+  long quota = read_long(path, -1);
+  snprintf(path, sizeof path, "/sys/fs/cgroup/%s%s/cpu.cfs_period_us", mount, dir);
+  long period = read_long(path, -1);
+  return quota_cpus(quota, period);
+}
+
+static int min_int(int a, int b) {
+  return a < b ? a : b;
+}
+
+// A quota on any ancestor also caps us, and a container's own group
+// often has none while its slice or pod does.  Take the smallest quota
+// from 'dir' up to (but not including) the root.  'dir' is modified.
+static int cgroup_cpus_upwards(const char *controllers, char *dir) {
+  int limit = INT_MAX;
+  while (*dir != '\0') {
+    limit = min_int(limit, *controllers == '\0' ? cgroup2_cpus(dir)
+                                                : cgroup1_cpus(controllers, dir));
+    char *slash = strrchr(dir, '/');
+    if (!slash) {
+      break;
+    }
+    *slash = '\0';
+  }
+  return limit;
+}
+
+// The CPU quota of the cgroup this process lives in and its
+// ancestors.  Inside a container the cgroup namespace usually makes
+// our own group the root, so the root files are tried as well.
+static int cgroup_cpus(void) {
+  int limit = min_int(cgroup2_cpus(""),
+                      min_int(cgroup1_cpus("cpu", ""), cgroup1_cpus("cpu,cpuacct", "")));
+
+  FILE *f = fopen("/proc/self/cgroup", "r");
+  if (!f) {
+    return limit;
+  }
+  char line[PATH_MAX];
+  while (fgets(line, sizeof line, f)) {
+    // Lines look like "0::/path" (v2) or "4:cpu,cpuacct:/path" (v1)
+    line[strcspn(line, "\n")] = '\0';
+    char *controllers = strchr(line, ':');
+    char *dir = controllers ? strchr(controllers + 1, ':') : NULL;
+    if (!dir) {
+      continue;
+    }
+    *dir++ = '\0';
+    controllers++;
+    if (strcmp(dir, "/") == 0) {
+      continue;
+    }
+    if (*controllers == '\0' || strstr(controllers, "cpu") != NULL) {
+      limit = min_int(limit, cgroup_cpus_upwards(controllers, dir));
+    }
+  }
+  fclose(f);
+  return limit;
+}
+
+int cpu_count_auto(void) {
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+  int n = online > 0 ? (int)online : 1;
+
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof set, &set) == 0) {
+    n = min_int(n, CPU_COUNT(&set));
+  }
+  n = min_int(n, cgroup_cpus());
+  return n < 1 ? 1 : n;
+}
+
+int parse_thread_count(const char *arg) {
+  if (strcmp(arg, "auto") == 0) {
+    return cpu_count_auto();
+  }
+  char *end;
+  errno = 0;
+  long n = strtol(arg, &end, 10);
+  if (errno || end == arg || *end != '\0' || n < 1 || n > INT_MAX) {
+    return -1;
+  }
+  return (int)n;
+}
+
+int parse_pin_mode(const char *arg, enum pin_mode *mode) {
+  if (strcmp(arg, "--pin") == 0 || strcmp(arg, "--pin=spread") == 0) {
+    *mode = PIN_SPREAD;
+  } else if (strcmp(arg, "--pin=compact") == 0) {
+    *mode = PIN_COMPACT;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+// Where a CPU sits in the machine.
+struct cpu_place {
+  int cpu;
+  int package;   // Socket
+  int l3;        // Lowest CPU sharing the same L3, as a domain id
+};
+
+// Find the L3 domain of a CPU: the first CPU listed in the
+// shared_cpu_list of its level-3 cache.  Falls back to the package.
+static int l3_domain(int cpu, int package) {
+  char path[PATH_MAX];
+  for (int i = 0; i < 16; i++) {
+    snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, i);
+    long level = read_long(path, -1);
+    if (level < 0) {
+      break;
+    }
+    if (level == 3) {
+      snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, i);
+      return (int)read_long(path, package);
+    }
+  }
+  return package;
+}
+
+static int cmp_place(const void *a, const void *b) {
+  const struct cpu_place *x = a, *y = b;
+  if (x->package != y->package) return x->package < y->package ? -1 : 1;
+  if (x->l3 != y->l3)           return x->l3 < y->l3 ? -1 : 1;
+  return x->cpu < y->cpu ? -1 : (x->cpu > y->cpu);
+}
+
+int cpu_plan_init(struct cpu_plan *plan, enum pin_mode mode) {
+  plan->mode = mode;
+  plan->cpus = NULL;
+  plan->ncpus = 0;
+  if (mode == PIN_NONE) {
+    return 0;
+  }
+
+  // Only CPUs we are allowed to run on are candidates
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof set, &set) != 0) {
+    return -1;
+  }
+  int n = CPU_COUNT(&set);
+  struct cpu_place *places = malloc(sizeof(struct cpu_place) * (size_t)n);
+  plan->cpus = malloc(sizeof(int) * (size_t)n);
+  if (!places || !plan->cpus) {
+    free(places);
+    free(plan->cpus);
+    plan->cpus = NULL;
+    return -1;
+  }
+
+  char path[PATH_MAX];
+  int k = 0;
+  for (int cpu = 0; cpu < CPU_SETSIZE && k < n; cpu++) {
+    if (!CPU_ISSET(cpu, &set)) {
+      continue;
+    }
+    snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    places[k].cpu = cpu;
+    places[k].package = (int)read_long(path, 0);
+    places[k].l3 = l3_domain(cpu, places[k].package);
+    k++;
+  }
+  // Compact order: socket, then L3 domain, then CPU number
+  qsort(places, (size_t)k, sizeof *places, cmp_place);
+
+  if (mode == PIN_COMPACT) {
+    for (int i = 0; i < k; i++) {
+      plan->cpus[i] = places[i].cpu;
+    }
+  } else {
+    // Spread: deal the CPUs out one domain at a time, taking the
+    // r-th CPU of every domain in round r
+    int out = 0;
+    for (int r = 0; out < k; r++) {
+      int start = 0;
+      while (start < k) {
+        int end = start;
+        while (end < k && places[end].package == places[start].package
+               && places[end].l3 == places[start].l3) {
+          end++;
+        }
+        if (start + r < end) {
+          plan->cpus[out++] = places[start + r].cpu;
+        }
+        start = end;
+      }
+    }
+  }
+  plan->ncpus = k;
+  free(places);
+  return 0;
+}
+
+void cpu_plan_destroy(struct cpu_plan *plan) {
+  free(plan->cpus);
+  plan->cpus = NULL;
+  plan->ncpus = 0;
+}
+
+int cpu_plan_attr(const struct cpu_plan *plan, int worker, pthread_attr_t *attr) {
+  if (pthread_attr_init(attr) != 0) {
+    return -1;
+  }
+  if (plan->mode == PIN_NONE || plan->ncpus == 0) {
+    return 0;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(plan->cpus[worker % plan->ncpus], &set);
+  if (pthread_attr_setaffinity_np(attr, sizeof set, &set) != 0) {
+    pthread_attr_destroy(attr);
+    return -1;
+  }
+  return 0;
+}
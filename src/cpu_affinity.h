@@ -0,0 +1,49 @@
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <pthread.h>
+
+// How worker threads are bound to CPUs.
+enum pin_mode {
+  PIN_NONE,      // Let the scheduler place threads
+  PIN_SPREAD,    // Round-robin across sockets/L3 domains
+  PIN_COMPACT    // Fill one L3 domain before moving to the next
+};
+
+// Ordered list of CPUs that workers are assigned to, one per worker
+// (wrapping around if there are more workers than CPUs).
+struct cpu_plan {
+  enum pin_mode mode;
+  int *cpus;
+  int ncpus;
+};
+
+// Number of CPUs this process may actually use.  Takes the minimum of
+// the online CPU count, the affinity mask, and any cgroup (v1 or v2)
+// CPU quota, rounded up.  Always returns at least 1.
+int cpu_count_auto(void);
+
+// Parse the argument to '-n'.  Accepts a positive integer or "auto".
+// Returns -1 on error.
+int parse_thread_count(const char *arg);
+
+// Parse a '--pin' or '--pin=MODE' option, where MODE is "spread" or
+// "compact" (plain '--pin' means "spread").  Returns non-zero if 'arg'
+// is not a valid pin option.
+int parse_pin_mode(const char *arg, enum pin_mode *mode);
+
+// Build the CPU order for the given mode from the sysfs topology.
+// Returns non-zero on error.  PIN_NONE never fails.
+int cpu_plan_init(struct cpu_plan *plan, enum pin_mode mode);
+
+// Free the memory held by a plan.
+void cpu_plan_destroy(struct cpu_plan *plan);
+
+// Initialise 'attr' for worker number 'worker'.  If the plan pins
+// threads, the attribute carries the CPU affinity so that the thread
+// starts out on its core, and everything it allocates is first
+// touched there.  The caller must pthread_attr_destroy() it.  Returns
+// non-zero on error.
+int cpu_plan_attr(const struct cpu_plan *plan, int worker, pthread_attr_t *attr);
+
+#endif
@@ -6,17 +6,42 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <stdint.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fts.h>
 #include <err.h>
 #include <pthread.h>
 #include "job_queue.h"
+#include "cpu_affinity.h"
+#include "shard.h"
+#include "line_pipeline.h"
+#include "search.h"
 
 // Initialize print mutex
 pthread_mutex_t stdout_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-static int fauxgrep_file_mt(char const *needle, char const *path) {
+// Set with --procs: the shard this process handles, the files found
+// by the parent's traversal, and in shared memory the next file to
+// claim and the ticket whose turn it is to print (see shard.h)
+struct shard_shared {
+  uint32_t next_file;
+  uint32_t output_turn;
+};
+static int shard_index = 0;
+static struct shard_files shard_list;
+static struct shard_shared *shared = NULL;
+
+// A file to search, and its position in the traversal (--procs only)
+struct job {
+  char *path;
+  uint32_t ticket;
+};
+
+// Search one file, printing matches to 'out'.  Only stdout is shared
+// between threads; other streams belong to the caller.
+static int fauxgrep_file_mt(const struct search *search, char const *path, FILE *out) {
   // Open file
   FILE *f = fopen(path, "r");
   // If file fails to open, return with warning
@@ -27,14 +52,19 @@ static int fauxgrep_file_mt(char const *needle, char const *path) {
 
   char *line = NULL;
   size_t linelen = 0;
+  ssize_t len;
   int linenum = 1;
 
-  while (getline(&line, &linelen, f) != -1) {
+  while ((len = getline(&line, &linelen, f)) != -1) {
     // If the substring is found in the haystack, print where it was found
-    if (strstr(line, needle) != NULL) {
-      assert(pthread_mutex_lock(&stdout_mutex) == 0);
-      printf("%s:%d: %s", path, linenum, line);
-      assert(pthread_mutex_unlock(&stdout_mutex) == 0);
+    if (search_find(search, line, (size_t)len) != NULL) {
+      if (out == stdout) {
+        assert(pthread_mutex_lock(&stdout_mutex) == 0);
+      }
+      fprintf(out, "%s:%d: %s", path, linenum, line);
+      if (out == stdout) {
+        assert(pthread_mutex_unlock(&stdout_mutex) == 0);
+      }
     }
     linenum++;
   }
@@ -48,20 +78,140 @@ static int fauxgrep_file_mt(char const *needle, char const *path) {
 static void* worker(void *arg){
   struct worker* w = (struct worker*)arg;
   struct job_queue *jq = w->jq;
-  const char *needle = w->needle;
+  const struct search *search = w->search;
 
   for (;;) { // endless for-loop/no condtion loop
-    char *path = NULL;
-    if (job_queue_pop(jq, (void**)&path) != 0 || path == NULL) { // Pop job of queue
+    struct job *job = NULL;
+    if (job_queue_pop(jq, (void**)&job) != 0 || job == NULL) { // Pop job of queue
       break; // pop failed/queue error or shutdown
     }
-    // Process the file popped from the queue
-    (void)fauxgrep_file_mt(needle, path); // Casting void ensures we get the side-effects of the function but disregarding the return value
-    free(path);
+    if (shared == NULL) {
+      // Process the file popped from the queue
+      (void)fauxgrep_file_mt(search, job->path, stdout); // Casting void ensures we get the side-effects of the function but disregarding the return value
+    } else {
+      // Several processes share stdout: collect this file's matches,
+      // then print them when every earlier file has been printed
+      char *buf = NULL;
+      size_t len = 0;
+      FILE *out = open_memstream(&buf, &len);
+      if (!out) {
+        err(1, "open_memstream() failed");
+      }
+      (void)fauxgrep_file_mt(search, job->path, out);
+      fclose(out);
+      shard_turn_wait(&shared->output_turn, job->ticket);
+      fwrite(buf, 1, len, stdout);
+      fflush(stdout);
+      shard_turn_advance(&shared->output_turn);
+      free(buf);
+    }
+    free(job->path);
+    free(job);
   } 
   return NULL;
 }
 
+// -- Streaming search of standard input --
+//
+// Standard input goes through a line pipeline (see line_pipeline.h).
+// Workers record the matches of a chunk together with their line
+// numbers within it, and the writer prints them in input order,
+// turning those into global line numbers.
+
+#define STREAM_BLOCK_SIZE (4 << 20)
+#define STREAM_CHUNK_SIZE (256 << 10)
+#define STREAM_MAX_PENDING 64
+#define STDIN_NAME "(standard input)"
+
+struct match {
+  const char *line;   // Points into the chunk's block
+  size_t len;         // Including the newline, if any
+  long lineno;        // Line number within the chunk, from 1
+};
+
+// The matches found in one chunk
+struct matches {
+  struct match *list;
+  size_t count;
+  size_t cap;
+  long lines;         // Number of lines in the chunk
+};
+
+struct stream {
+  const struct search *search;
+  long lines;         // Lines in all chunks printed so far
+};
+
+static void grep_batch(struct line_batch *b, void *arg) {
+  const struct stream *stream = arg;
+  struct matches *m = calloc(1, sizeof(struct matches));
+  if (!m) {
+    err(1, "calloc() for matches failed");
+  }
+  const char *p = b->chunk.start;
+  const char *end = p + b->chunk.len;
+  long lineno = 0;
+  while (p < end) {
+    const char *nl = memchr(p, '\n', (size_t)(end - p));
+    const char *next = nl ? nl + 1 : end;
+    lineno++;
+    if (search_find(stream->search, p, (size_t)(next - p)) != NULL) {
+      if (m->count == m->cap) {
+        m->cap = m->cap ? 2 * m->cap : 16;
+        m->list = realloc(m->list, sizeof(struct match) * m->cap);
+        if (!m->list) {
+          err(1, "realloc() for matches failed");
+        }
+      }
+      m->list[m->count++] = (struct match) {
+        .line = p, .len = (size_t)(next - p), .lineno = lineno
+      };
+    }
+    p = next;
+  }
+  m->lines = lineno;
+  b->result = m;
+}
+
+// Print the matches of a chunk.  Chunks arrive in input order.
+static void print_matches(struct line_batch *b, FILE *out, void *arg) {
+  struct stream *stream = arg;
+  struct matches *m = b->result;
+  for (size_t i = 0; i < m->count; i++) {
+    fprintf(out, "%s:%ld: ", STDIN_NAME, stream->lines + m->list[i].lineno);
+    fwrite(m->list[i].line, 1, m->list[i].len, out);
+  }
+  stream->lines += m->lines;
+  free(m->list);
+  free(m);
+}
+
+// Search standard input with a pool of 'num_threads' workers.
+// Returns non-zero if reading failed.
+static int grep_stdin(const struct search *search, int num_threads, const struct cpu_plan *plan) {
+  struct stream stream = {
+    .search = search,
+    .lines = 0
+  };
+  struct line_pipeline pipeline = {
+    .fd = STDIN_FILENO,
+    .block_size = STREAM_BLOCK_SIZE,
+    .chunk_size = STREAM_CHUNK_SIZE,
+    .max_pending = STREAM_MAX_PENDING,
+    .num_threads = num_threads,
+    .plan = plan,
+    .work = grep_batch,
+    .emit = print_matches,
+    .arg = &stream,
+    .out = stdout
+  };
+  if (line_pipeline_run(&pipeline) != 0) {
+    warn("failed to read stdin");
+    return -1;
+  }
+  return 0;
+}
+
 // Producer that traverse directories with FTS and enqueue files
 static void traverse_and_enqueue(struct job_queue *jq, char * const *paths) {
   int fts_options = FTS_LOGICAL | FTS_NOCHDIR;
@@ -76,11 +226,16 @@ static void traverse_and_enqueue(struct job_queue *jq, char * const *paths) {
       case FTS_D:
         break;
       case FTS_F: {
+        struct job *job = calloc(1, sizeof(struct job));
+        if (!job) {
+          err(1, "calloc() for job failed");
+        }
         // strdup: FTS uses internal buffers that get reused, so we must copy
-        char *copy = strdup(p->fts_path);
-        if (job_queue_push(jq, copy) != 0) {
+        job->path = strdup(p->fts_path);
+        if (job_queue_push(jq, job) != 0) {
           warn("job_queue_push() failed - stopping traversal"); // If push fails due to shutdown, stop producing.
-          free(copy);
+          free(job->path);
+          free(job);
           break;
         }
       }
@@ -91,28 +246,109 @@ static void traverse_and_enqueue(struct job_queue *jq, char * const *paths) {
   fts_close(ftsp);
 }
 
-int main(int argc, char * const *argv) {
-  if (argc < 2) {
-    err(1, "usage: [-n INT] STRING paths...");
-    exit(1);
+// Producer with --procs: claim files from the list the parent
+// collected until every file has been claimed by some shard
+static void claim_and_enqueue(struct job_queue *jq) {
+  size_t i;
+  while ((i = shard_claim(&shared->next_file)) < shard_list.count) {
+    struct job *job = malloc(sizeof(struct job));
+    if (!job || !(job->path = strdup(shard_list.paths[i]))) {
+      err(1, "malloc() for job failed");
+    }
+    job->ticket = (uint32_t)i;
+    if (job_queue_push(jq, job) != 0) {
+      // Every later ticket would wait for this one forever
+      errx(1, "job_queue_push() failed");
+    }
   }
+}
 
+int main(int argc, char * const *argv) {
   int num_threads = 1;
-  char const *needle;
-  char * const *paths;
-
-  if (argc > 3 && strcmp(argv[1], "-n") == 0) {
-    // Simple atoi parsing (same note as template): non-numeric becomes 0.
-    num_threads = atoi(argv[2]);
-    if (num_threads < 1) {
-      err(1, "invalid thread count: %s", argv[2]);
+  int num_procs = 1;
+  bool icase = false, word = false;
+  enum pin_mode pin = PIN_NONE;
+  int argi = 1;
+
+  // Parse options: "-n INT|auto", "--pin[=spread|compact]",
+  // "--procs INT|auto", "-i" (ignore case) and "-w" (whole words)
+  for (; argi < argc && argv[argi][0] == '-'; argi++) {
+    if (strcmp(argv[argi], "--") == 0) {
+      argi++;
+      break;
+    } else if (strcmp(argv[argi], "-n") == 0 && argi + 1 < argc) {
+      num_threads = parse_thread_count(argv[++argi]);
+      if (num_threads < 1) {
+        err(1, "invalid thread count: %s", argv[argi]);
+      }
+    } else if (strncmp(argv[argi], "--pin", 5) == 0) {
+      if (parse_pin_mode(argv[argi], &pin) != 0) {
+        err(1, "invalid pin mode: %s", argv[argi]);
+      }
+    } else if (strcmp(argv[argi], "--procs") == 0 && argi + 1 < argc) {
+      num_procs = parse_thread_count(argv[++argi]);
+      if (num_procs < 1) {
+        err(1, "invalid process count: %s", argv[argi]);
+      }
+    } else if (strcmp(argv[argi], "-i") == 0) {
+      icase = true;
+    } else if (strcmp(argv[argi], "-w") == 0) {
+      word = true;
+    } else {
+      break; // Not an option, so it must be the needle
     }
-    needle = argv[3];
-    paths = &argv[4];
-  } else {
-    needle = argv[1];
-    paths = &argv[2];
   }
+  if (argi >= argc) {
+    err(1, "usage: [-n INT|auto] [--pin[=spread|compact]] [--procs INT|auto] [-i] [-w] STRING [paths...]");
+  }
+  struct search search;
+  search_init(&search, argv[argi], icase, word);
+  char * const *paths = &argv[argi + 1];
+
+  // Without paths (or with just "-") search standard input instead
+  bool from_stdin = paths[0] == NULL || (strcmp(paths[0], "-") == 0 && paths[1] == NULL);
+  if (from_stdin && num_procs > 1) {
+    errx(1, "--procs cannot be used when reading standard input");
+  }
+
+  // With --procs, walk the paths once, then fork one process per shard,
+  // each running its own pool of -n threads over files claimed from
+  // that list.  The parent only waits for them.
+  if (num_procs > 1) {
+    if (shard_files_collect(&shard_list, paths) != 0) {
+      err(1, "traversing the paths failed");
+    }
+    shared = shard_shm_alloc(sizeof *shared);
+    pid_t *pids = calloc((size_t)num_procs, sizeof(pid_t));
+    if (!shared || !pids) {
+      err(1, "allocating shard state failed");
+    }
+    int shard = shard_fork(num_procs, pids);
+    if (shard == -2) {
+      err(1, "fork() failed");
+    }
+    if (shard == -1) {
+      int failed = shard_wait(pids, num_procs);
+      free(pids);
+      shard_shm_free(shared, sizeof *shared);
+      shard_files_free(&shard_list);
+      return failed ? 1 : 0;
+    }
+    free(pids);
+    shard_index = shard;
+  }
+
+  // Decide which CPU each worker is bound to (if any)
+  struct cpu_plan plan;
+  if (cpu_plan_init(&plan, pin) != 0) {
+    err(1, "cpu_plan_init() failed");
+  }
+  if (from_stdin) {
+    int failed = grep_stdin(&search, num_threads, &plan);
+    cpu_plan_destroy(&plan);
+    return failed ? 1 : 0;
+  }
+
   // Initialize the job queue
   struct job_queue jq;
   if (job_queue_init(&jq, 128) != 0) {
@@ -121,7 +357,7 @@ int main(int argc, char * const *argv) {
 
   struct worker w = {
     .jq = &jq,
-    .needle = needle
+    .search = &search
   };
   // Allocate for worker threads
   pthread_t *threads = calloc((size_t)num_threads, sizeof(pthread_t));
@@ -130,12 +366,21 @@ int main(int argc, char * const *argv) {
   }
   // Create worker threads
   for (int i = 0; i < num_threads; i++){
-    if (pthread_create(&threads[i], NULL, worker, &w) != 0 ){
+    pthread_attr_t attr;
+    if (cpu_plan_attr(&plan, shard_index * num_threads + i, &attr) != 0) {
+      err(1, "cpu_plan_attr() failed");
+    }
+    if (pthread_create(&threads[i], &attr, worker, &w) != 0 ){
       err(1, "pthread_create() failed");
     }
+    pthread_attr_destroy(&attr);
+  }
+  if (shared) {
+    claim_and_enqueue(&jq);
+  } else {
+    // Traverse directories and enqueue jobs
+    traverse_and_enqueue(&jq, paths);
   }
-  // Traverse directories and enqueue jobs
-  traverse_and_enqueue(&jq, paths);
   // Producer done – signal workers to stop
   for (int i = 0; i < num_threads; i++) {
     job_queue_push(&jq, NULL);
@@ -147,8 +392,10 @@ int main(int argc, char * const *argv) {
     }
   }
   free(threads);
+  cpu_plan_destroy(&plan);
   // Shut down the job queue
   job_queue_destroy(&jq);
+  shard_files_free(&shard_list);
 
   return 0;
 }
\ No newline at end of file
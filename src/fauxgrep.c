@@ -15,7 +15,9 @@
 // very handy.
 #include <err.h>
 
-int fauxgrep_file(char const *needle, char const *path) {
+#include "search.h"
+
+int fauxgrep_file(const struct search *search, char const *path) {
   FILE *f = fopen(path, "r");
 
   if (f == NULL) {
@@ -25,10 +27,11 @@ int fauxgrep_file(char const *needle, char const *path) {
 
   char *line = NULL;
   size_t linelen = 0;
+  ssize_t len;
   int lineno = 1;
 
-  while (getline(&line, &linelen, f) != -1) {
-    if (strstr(line, needle) != NULL) {
+  while ((len = getline(&line, &linelen, f)) != -1) {
+    if (search_find(search, line, (size_t)len) != NULL) {
       printf("%s:%d: %s", path, lineno, line);
     }
 
@@ -42,13 +45,28 @@ int fauxgrep_file(char const *needle, char const *path) {
 }
 
 int main(int argc, char * const *argv) {
-  if (argc < 2) {
-    err(1, "usage: STRING paths...");
+  bool icase = false, word = false;
+  int argi = 1;
+
+  // -i ignores case and -w only matches whole words
+  for (; argi < argc; argi++) {
+    if (strcmp(argv[argi], "-i") == 0) {
+      icase = true;
+    } else if (strcmp(argv[argi], "-w") == 0) {
+      word = true;
+    } else {
+      break;
+    }
+  }
+
+  if (argi >= argc) {
+    err(1, "usage: [-i] [-w] STRING paths...");
     exit(1);
   }
 
-  char const *needle = argv[1];
-  char * const *paths = &argv[2];
+  struct search search;
+  search_init(&search, argv[argi], icase, word);
+  char * const *paths = &argv[argi + 1];
 
   // FTS_LOGICAL = follow symbolic links
   // FTS_NOCHDIR = do not change the working directory of the process
@@ -69,7 +87,7 @@ int main(int argc, char * const *argv) {
     case FTS_D:
       break;
     case FTS_F:
-      fauxgrep_file(needle, p->fts_path);
+      fauxgrep_file(&search, p->fts_path);
       break;
     default:
       break;
@@ -8,46 +8,169 @@
 #include <string.h>
 #include <stdint.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/inotify.h>
 #include <fts.h>
 #include <err.h>
 #include "job_queue.h"
 #include "histogram.h"  
+#include "cpu_affinity.h"
+#include "byte_stats.h"
+#include "shard.h"
+#include "watch.h"
 
 static int global_histogram[8] = {0};
+static struct byte_stats global_stats;   // Guarded by hist_mutex
 static pthread_mutex_t hist_mutex  = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t print_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// What to report besides the 8-bit histogram (set by --stats)
+enum stats_mode {
+  STATS_NONE,      // Live histogram display only
+  STATS_SUMMARY,   // Per-file and total entropy and NUL/non-ASCII ratios
+  STATS_FULL       // ... plus the byte-value histogram of each
+};
+static enum stats_mode stats_mode = STATS_NONE;
+
+// With --procs, every shard process adds its counts to these totals
+// in shared memory using atomic adds, and the parent displays them.
+// Shards claim files by taking 'next_file'.
+struct shared_totals {
+  int64_t bits[8];
+  struct byte_stats stats;
+  uint32_t next_file;
+};
+static struct shared_totals *shared = NULL;
+static int shard_index = 0;
+static struct shard_files shard_list;   // Found by the parent's traversal
+
+// With --watch, the inotify watches and what each file contributed
+static struct watch *watching = NULL;
+
+// With --watch, the files named on the command line.  They are watched
+// through their directories, so one replaced by a rename (as in log
+// rotation) is picked up again.
+struct named_file {
+  char *path;          // As given, which is how FTS names it too
+  const char *name;    // Last component of 'path'
+  int wd;              // Watch on its directory
+};
+static struct named_file *named_files = NULL;
+static size_t num_named = 0;
+
 #define PRINT_INTERVAL 100000   // bytes per progress update 
+#define READ_SIZE (64 << 10)    // bytes per fread() 
+#define SHARD_POLL_US 100000    // parent display interval with --procs
 
 // Merge local -> global under lock
 static void merge_into_global_mt(int local[8]) {
+  if (shared) {
+    for (int i = 0; i < 8; i++) {
+      __atomic_fetch_add(&shared->bits[i], local[i], __ATOMIC_RELAXED);
+      local[i] = 0;
+    }
+    return;
+  }
   pthread_mutex_lock(&hist_mutex);
   merge_histogram(local, global_histogram); 
   pthread_mutex_unlock(&hist_mutex);
 }
 
+// Merge a file's byte statistics into the totals
+static void merge_stats_mt(struct byte_stats *file_stats) {
+  if (shared) {
+    for (int v = 0; v < 256; v++) {
+      if (file_stats->counts[v]) {
+        __atomic_fetch_add(&shared->stats.counts[v], file_stats->counts[v], __ATOMIC_RELAXED);
+      }
+    }
+    memset(file_stats, 0, sizeof *file_stats);
+    return;
+  }
+  pthread_mutex_lock(&hist_mutex);
+  byte_stats_merge(file_stats, &global_stats);
+  pthread_mutex_unlock(&hist_mutex);
+}
+
+// Copy the shared totals into this process's globals
+static void load_shared_totals(void) {
+  for (int i = 0; i < 8; i++) {
+    global_histogram[i] = (int)__atomic_load_n(&shared->bits[i], __ATOMIC_RELAXED);
+  }
+  for (int v = 0; v < 256; v++) {
+    global_stats.counts[v] = __atomic_load_n(&shared->stats.counts[v], __ATOMIC_RELAXED);
+  }
+}
+
 // Print current global safely
 static void print_global_mt(void) {
   int snap[8];
 
-  // Take a snapshot under the histogram lock
+  // Take the snapshot while holding the print lock, so snapshots are
+  // printed in the order they were taken and the last one shown is
+  // the newest
+  pthread_mutex_lock(&print_mutex);
   pthread_mutex_lock(&hist_mutex);
   memcpy(snap, global_histogram, sizeof snap);
   pthread_mutex_unlock(&hist_mutex);
+  print_histogram(snap);
+  pthread_mutex_unlock(&print_mutex);
+}
 
-  // Print the snapshot under the print lock
+// Print the statistics of one file (or the total) on a few lines
+static void print_byte_stats(const char *label, const struct byte_stats *stats) {
   pthread_mutex_lock(&print_mutex);
-  print_histogram(snap);
+  printf("%s: %llu bytes, entropy %.4f bits/byte, NUL %.2f%%, non-ASCII %.2f%%\n",
+         label, (unsigned long long)byte_stats_total(stats),
+         byte_stats_entropy(stats),
+         100 * byte_stats_nul_ratio(stats),
+         100 * byte_stats_non_ascii_ratio(stats));
+  if (stats_mode == STATS_FULL) {
+    for (int v = 0; v < 256; v++) {
+      if (stats->counts[v]) {
+        printf("  0x%02x: %llu\n", v, (unsigned long long)stats->counts[v]);
+      }
+    }
+  }
+  if (shared) {
+    fflush(stdout); // Other processes print too; keep our lines whole
+  }
   pthread_mutex_unlock(&print_mutex);
 }
 
+// Remember what a file contributed, and where its counted bytes end,
+// so --watch can later update it incrementally.  'mtime' is the file's
+// modification time from before it was read.
+static void record_file(const char *path, int fd, const struct byte_stats *file_stats,
+                        struct timespec mtime) {
+  struct watch_file *e = watch_file_get(watching, path, true);
+  if (!e) {
+    err(1, "recording %s failed", path);
+  }
+  memset(e->bits, 0, sizeof e->bits);
+  byte_stats_bits(file_stats, e->bits);
+  e->offset = (off_t)byte_stats_total(file_stats);
+  e->fingerprint = watch_fingerprint(fd, e->offset);
+  e->mtime = mtime;
+}
+
 // -- Instruction set for worker threads --
 static void* worker(void *arg) {
   struct worker *wa = arg;
   struct job_queue *jq = wa->jq;
 
+  // Read buffer allocated by the worker itself, so it lives near the
+  // CPU the worker runs on
+  unsigned char *buf = malloc(READ_SIZE);
+  if (!buf) {
+    err(1, "malloc() for read buffer failed");
+  }
+
   for (;;) {
     char *path = NULL;
     if (job_queue_pop(jq, (void**)&path) != 0 || path == NULL) { // Pop job of the queue
@@ -64,27 +187,89 @@ static void* worker(void *arg) {
     }
 
     int local[8] = {0};
+    struct byte_stats file_stats, block_stats;
+    memset(&file_stats, 0, sizeof file_stats);
     size_t bytes_since_print = 0;
-    unsigned char byte;
+    size_t n;
+    struct stat st;
+    if (watching && fstat(fileno(f), &st) != 0) {
+      err(1, "fstat() failed for %s", path);
+    }
 
-    // Read byte-by-byte since update_histogram() takes ONE byte 
-    while (fread(&byte, 1, 1, f) == 1) {
-      update_histogram(local, byte);
-      if (++bytes_since_print % PRINT_INTERVAL == 0) {
+    // One pass per block: count byte values, and derive the bit
+    // histogram and the per-file statistics from those counts
+    (void)update_histogram; // Replaced by byte_stats_bits() below
+    while ((n = fread(buf, 1, READ_SIZE, f)) > 0) {
+      memset(&block_stats, 0, sizeof block_stats);
+      byte_stats_update(&block_stats, buf, n);
+      byte_stats_bits(&block_stats, local);
+      byte_stats_merge(&block_stats, &file_stats);
+      bytes_since_print += n;
+      if (bytes_since_print >= PRINT_INTERVAL) {
         merge_into_global_mt(local);
-        print_global_mt();
+        if (stats_mode == STATS_NONE && !shared) {
+          print_global_mt();
+        }
         bytes_since_print = 0;
       }
     }
+    if (watching) {
+      record_file(path, fileno(f), &file_stats, st.st_mtim);
+    }
     fclose(f);
 
     // Flush remainder for this file and show progress
     merge_into_global_mt(local);
-    print_global_mt();
+    if (stats_mode != STATS_NONE) {
+      print_byte_stats(path, &file_stats);
+    } else if (!shared) {
+      print_global_mt();
+    }
+    merge_stats_mt(&file_stats);
 
     free(path);
   }
 
+  free(buf);
+  return NULL;
+}
+
+// Watch a file named on the command line through its directory
+static void watch_named_file(const char *path) {
+  char *dir = strdup(path);
+  struct named_file *grown = realloc(named_files, sizeof(struct named_file) * (num_named + 1));
+  if (!dir || !grown) {
+    err(1, "recording %s failed", path);
+  }
+  named_files = grown;
+  char *slash = strrchr(dir, '/');
+  if (!slash) {
+    strcpy(dir, ".");
+  } else {
+    slash[slash == dir ? 1 : 0] = '\0';
+  }
+  int wd = watch_add(watching, dir, false);
+  free(dir);
+  if (wd < 0) {
+    warn("cannot watch %s", path);
+    return;
+  }
+  struct named_file *nf = &named_files[num_named++];
+  if (!(nf->path = strdup(path))) {
+    err(1, "recording %s failed", path);
+  }
+  slash = strrchr(nf->path, '/');
+  nf->name = slash ? slash + 1 : nf->path;
+  nf->wd = wd;
+}
+
+// The named file 'name' in the directory watched by 'wd', if any
+static const struct named_file *find_named(int wd, const char *name) {
+  for (size_t i = 0; i < num_named; i++) {
+    if (named_files[i].wd == wd && strcmp(named_files[i].name, name) == 0) {
+      return &named_files[i];
+    }
+  }
   return NULL;
 }
 
@@ -100,8 +285,14 @@ static void traverse_and_enqueue(struct job_queue *jq, char * const *paths) {
   while ((p = fts_read(ftsp)) != NULL) {
     switch (p->fts_info) {
       case FTS_D:
+        if (watching && watch_add(watching, p->fts_path, true) < 0) {
+          warn("cannot watch %s", p->fts_path);
+        }
         break;
       case FTS_F: {
+        if (watching && p->fts_level == 0) {
+          watch_named_file(p->fts_path);
+        }
         char *copy = strdup(p->fts_path);
         // strdup() because FTS reuses internal buffers
         if (job_queue_push(jq, copy) != 0) {
@@ -118,24 +309,21 @@ static void traverse_and_enqueue(struct job_queue *jq, char * const *paths) {
   fts_close(ftsp);
 }
 
-int main(int argc, char * const *argv) {
-  if (argc < 2) {
-    err(1, "usage: paths...");
-    exit(1);
-  }
-
-  int num_threads = 1;
-  char * const *paths;
-
-  // Parse optional "-n k" like the template 
-  if (argc > 3 && strcmp(argv[1], "-n") == 0) {
-    num_threads = atoi(argv[2]);
-    if (num_threads < 1) err(1, "invalid thread count: %s", argv[2]);
-    paths = &argv[3];
-  } else {
-    paths = &argv[1];
+// Producer with --procs: claim files from the list the parent
+// collected until every file has been claimed by some shard
+static void claim_and_enqueue(struct job_queue *jq) {
+  size_t i;
+  while ((i = shard_claim(&shared->next_file)) < shard_list.count) {
+    char *copy = strdup(shard_list.paths[i]);
+    if (!copy || job_queue_push(jq, copy) != 0) {
+      err(1, "queueing %s failed", shard_list.paths[i]);
+    }
   }
+}
 
+// Run a pool of worker threads over the files in 'paths' (or, with
+// --procs, over those this shard claims)
+static void run_workers(char * const *paths, int num_threads, enum pin_mode pin) {
   // Initialize job queue
   struct job_queue jq;
   if (job_queue_init(&jq, 128) != 0) {
@@ -151,14 +339,28 @@ int main(int argc, char * const *argv) {
   struct worker wa = { 
     .jq = &jq 
   };
+  // Decide which CPU each worker is bound to (if any)
+  struct cpu_plan plan;
+  if (cpu_plan_init(&plan, pin) != 0) {
+    err(1, "cpu_plan_init() failed");
+  }
   // Create worker threads 
   for (int i = 0; i < num_threads; i++) {
-    if (pthread_create(&threads[i], NULL, worker, &wa) != 0) {
+    pthread_attr_t attr;
+    if (cpu_plan_attr(&plan, shard_index * num_threads + i, &attr) != 0) {
+      err(1, "cpu_plan_attr() failed");
+    }
+    if (pthread_create(&threads[i], &attr, worker, &wa) != 0) {
       err(1, "pthread_create() failed");
     }
+    pthread_attr_destroy(&attr);
   }
   // Traverse directories and enqueue jobs
-  traverse_and_enqueue(&jq, paths);
+  if (shared) {
+    claim_and_enqueue(&jq);
+  } else {
+    traverse_and_enqueue(&jq, paths);
+  }
   // Producer done – signal workers to stop
   for (int i = 0; i < num_threads; i++) {
       job_queue_push(&jq, NULL);
@@ -170,10 +372,283 @@ int main(int argc, char * const *argv) {
     }
   }
   free(threads);
+  cpu_plan_destroy(&plan);
   // Shut down the job queue
   job_queue_destroy(&jq);
+}
+
+// Walk the paths once, then fork one process per shard, each running
+// its own pool over files claimed from that list, and display the
+// shared totals until they are done.  Only returns in the parent,
+// with the totals loaded into the globals.  Returns non-zero if a
+// shard failed.
+static int run_shards(char * const *paths, int num_threads, int num_procs, enum pin_mode pin) {
+  if (shard_files_collect(&shard_list, paths) != 0) {
+    err(1, "traversing the paths failed");
+  }
+  shared = shard_shm_alloc(sizeof *shared);
+  pid_t *pids = calloc((size_t)num_procs, sizeof(pid_t));
+  if (!shared || !pids) {
+    err(1, "allocating shard state failed");
+  }
+  int shard = shard_fork(num_procs, pids);
+  if (shard == -2) {
+    err(1, "fork() failed");
+  }
+  if (shard >= 0) {
+    free(pids);
+    shard_index = shard;
+    run_workers(paths, num_threads, pin);
+    exit(0);
+  }
+
+  int failed = 0;
+  while (shard_poll(pids, num_procs, &failed) > 0) {
+    if (stats_mode == STATS_NONE) {
+      load_shared_totals();
+      print_histogram(global_histogram);
+      fflush(stdout);
+    }
+    usleep(SHARD_POLL_US);
+  }
+  load_shared_totals();
+  if (stats_mode == STATS_NONE) {
+    print_histogram(global_histogram);
+  }
+  free(pids);
+  shard_shm_free(shared, sizeof *shared);
+  shared = NULL;
+  shard_files_free(&shard_list);
+  return failed;
+}
+
+// Count the bytes of 'fd' from 'offset' to the end into 'bits'.
+// Returns the new end.
+static off_t count_from(int fd, off_t offset, int bits[8], unsigned char *buf) {
+  struct byte_stats block_stats;
+  ssize_t n;
+  while ((n = pread(fd, buf, READ_SIZE, offset)) > 0) {
+    memset(&block_stats, 0, sizeof block_stats);
+    byte_stats_update(&block_stats, buf, (size_t)n);
+    byte_stats_bits(&block_stats, bits);
+    offset += n;
+  }
+  return offset;
+}
+
+// Take a removed file's contribution back out of the histogram
+static void forget_file(struct watch_file *e) {
+  int delta[8];
+  for (int i = 0; i < 8; i++) {
+    delta[i] = -e->bits[i];
+  }
+  merge_into_global_mt(delta);
+}
+
+// Bring a changed (or new) file up to date.  Only a file that grew and
+// whose counted bytes still have the same fingerprint is taken to be
+// appended to, and then only the new bytes are read.  Anything else,
+// such as a write in place or a truncation, subtracts the file's old
+// contribution and counts the whole file again.
+static void update_file(const char *path, unsigned char *buf) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return; // Gone again; the delete event will follow
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return;
+  }
+  struct watch_file *e = watch_file_get(watching, path, true);
+  if (!e) {
+    err(1, "recording %s failed", path);
+  }
+
+  // Same size and time: nothing new, e.g. the close after writes that
+  // were already handled
+  if (st.st_size == e->offset && st.st_mtim.tv_sec == e->mtime.tv_sec
+      && st.st_mtim.tv_nsec == e->mtime.tv_nsec) {
+    close(fd);
+    return;
+  }
+  int delta[8] = {0};
+  if (st.st_size <= e->offset || watch_fingerprint(fd, e->offset) != e->fingerprint) {
+    for (int i = 0; i < 8; i++) {
+      delta[i] = -e->bits[i];
+      e->bits[i] = 0;
+    }
+    e->offset = 0;
+  }
+  int added[8] = {0};
+  e->offset = count_from(fd, e->offset, added, buf);
+  e->fingerprint = watch_fingerprint(fd, e->offset);
+  e->mtime = st.st_mtim;
+  close(fd);
+
+  for (int i = 0; i < 8; i++) {
+    e->bits[i] += added[i];
+    delta[i] += added[i];
+  }
+  merge_into_global_mt(delta);
+}
+
+// Watch and count everything below a directory that just appeared
+static void watch_tree(char *path, unsigned char *buf) {
+  char *paths[] = { path, NULL };
+  FTS *ftsp = fts_open(paths, FTS_LOGICAL | FTS_NOCHDIR, NULL);
+  if (!ftsp) {
+    warn("fts_open() failed for %s", path);
+    return;
+  }
+  FTSENT *p;
+  while ((p = fts_read(ftsp)) != NULL) {
+    if (p->fts_info == FTS_D) {
+      if (watch_add(watching, p->fts_path, true) < 0) {
+        warn("cannot watch %s", p->fts_path);
+      }
+    } else if (p->fts_info == FTS_F) {
+      update_file(p->fts_path, buf);
+    }
+  }
+  fts_close(ftsp);
+}
+
+static void handle_event(const struct inotify_event *ev, unsigned char *buf) {
+  if (ev->mask & IN_Q_OVERFLOW) {
+    warnx("inotify queue overflowed; some changes were missed");
+    return;
+  }
+  if (ev->mask & IN_IGNORED) {
+    watch_remove(watching, ev->wd);
+    return;
+  }
+  const char *base = watch_path(watching, ev->wd);
+  if (!base || ev->len == 0) {
+    return;
+  }
+  // Build the path the same way FTS does, so table lookups match
+  char path[PATH_MAX];
+  const struct named_file *named = find_named(ev->wd, ev->name);
+  if (named) {
+    snprintf(path, sizeof path, "%s", named->path);
+  } else if (watch_is_tree(watching, ev->wd)) {
+    size_t n = strlen(base);
+    snprintf(path, sizeof path, "%s%s%s", base, (n && base[n-1] == '/') ? "" : "/", ev->name);
+  } else {
+    return; // Next to a named file, but not named itself
+  }
+
+  if (ev->mask & IN_ISDIR) {
+    if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+      watch_tree(path, buf);
+    } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+      watch_file_remove(watching, path, true, forget_file);
+    }
+  } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+    watch_file_remove(watching, path, false, forget_file);
+  } else if (ev->mask & (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO)) {
+    update_file(path, buf);
+  }
+}
+
+// Apply inotify events to the histogram until killed, redrawing the
+// display after each batch of events
+static void watch_loop(void) {
+  unsigned char *buf = malloc(READ_SIZE);
+  char *events = malloc(READ_SIZE);
+  if (!buf || !events) {
+    err(1, "malloc() for watch buffers failed");
+  }
+  for (;;) {
+    ssize_t n = read(watching->fd, events, READ_SIZE);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      err(1, "reading inotify events failed");
+    }
+    for (char *p = events; p < events + n; ) {
+      // The kernel pads each record so the next one stays aligned
+      const struct inotify_event *ev = (const struct inotify_event*)p;
+      handle_event(ev, buf);
+      p += sizeof *ev + ev->len;
+    }
+    print_global_mt();
+    fflush(stdout);
+  }
+}
+
+int main(int argc, char * const *argv) {
+  int num_threads = 1;
+  int num_procs = 1;
+  int failed = 0;
+  bool watch_mode = false;
+  enum pin_mode pin = PIN_NONE;
+  int argi = 1;
+
+  // Parse options: "-n INT|auto", "--pin[=spread|compact]",
+  // "--stats[=full]", "--procs INT|auto" and "--watch"
+  for (; argi < argc && argv[argi][0] == '-'; argi++) {
+    if (strcmp(argv[argi], "--") == 0) {
+      argi++;
+      break;
+    } else if (strcmp(argv[argi], "-n") == 0 && argi + 1 < argc) {
+      num_threads = parse_thread_count(argv[++argi]);
+      if (num_threads < 1) err(1, "invalid thread count: %s", argv[argi]);
+    } else if (strncmp(argv[argi], "--pin", 5) == 0) {
+      if (parse_pin_mode(argv[argi], &pin) != 0) err(1, "invalid pin mode: %s", argv[argi]);
+    } else if (strcmp(argv[argi], "--procs") == 0 && argi + 1 < argc) {
+      num_procs = parse_thread_count(argv[++argi]);
+      if (num_procs < 1) err(1, "invalid process count: %s", argv[argi]);
+    } else if (strcmp(argv[argi], "--watch") == 0) {
+      watch_mode = true;
+    } else if (strcmp(argv[argi], "--stats") == 0) {
+      stats_mode = STATS_SUMMARY;
+    } else if (strcmp(argv[argi], "--stats=full") == 0) {
+      stats_mode = STATS_FULL;
+    } else {
+      break; // First path
+    }
+  }
+  if (argi >= argc) {
+    err(1, "usage: [-n INT|auto] [--pin[=spread|compact]] [--stats[=full]] [--procs INT|auto] [--watch] paths...");
+  }
+  char * const *paths = &argv[argi];
+
+  // The per-file state of --watch lives in this process, and its live
+  // display would be mixed up with per-file statistics
+  struct watch watch;
+  if (watch_mode) {
+    if (num_procs > 1 || stats_mode != STATS_NONE) {
+      errx(1, "--watch cannot be combined with --procs or --stats");
+    }
+    if (watch_init(&watch) != 0) {
+      err(1, "watch_init() failed");
+    }
+    watching = &watch;
+  }
+
+  if (num_procs > 1) {
+    failed = run_shards(paths, num_threads, num_procs, pin);
+  } else {
+    run_workers(paths, num_threads, pin);
+  }
+  if (watching) {
+    // Keep the display up to date from here on; never returns
+    print_global_mt();
+    watch_loop();
+  }
   // Final tidy output position just like the ST version
-  move_lines(9); // keep UI neat after last print  
+  if (stats_mode != STATS_NONE) {
+    // No live display was shown, so print the final histogram and the
+    // totals below the per-file lines
+    print_histogram(global_histogram);
+    move_lines(9);
+    print_byte_stats("total", &global_stats);
+  } else {
+    move_lines(9); // keep UI neat after last print  
+  }
 
-  return 0;
+  return failed ? 1 : 0;
 }
\ No newline at end of file
@@ -12,6 +12,8 @@
 #include <assert.h>
 #include <string.h>
 #include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -21,103 +23,329 @@
 // very handy.
 #include <err.h>
 
-#include "job_queue.h"
+#include "cpu_affinity.h"
+#include "bignum.h"
+#include "line_pipeline.h"
 
-// Whenever we print to the screen, we will first lock this mutex.
-// This ensures that multiple threads do not try to print
-// concurrently.
-pthread_mutex_t stdout_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Standard input is read in blocks of BLOCK_SIZE bytes, which are cut
+// into batches of about BATCH_SIZE bytes of whole lines.  One batch is
+// one job, and at most MAX_PENDING are in flight (see line_pipeline.h).
+#define BLOCK_SIZE (1 << 20)
+#define BATCH_SIZE (8 << 10)
+#define MAX_PENDING 256
 
-// A simple recursive (inefficient) implementation of the Fibonacci
-// function.
-int fib (int n) {
-  if (n < 2) {
-    return 1;
-  } else {
-    return fib(n-1) + fib(n-2);
+// The output produced for a batch, printed by the writer thread.
+struct output {
+  char *buf;
+  size_t len;
+};
+
+// Compute the Fibonacci number F(m), with F(0) = 0 and F(1) = 1, by
+// fast doubling.  Walking the bits of 'm' from the top, we keep
+// a = F(k) and b = F(k+1) and use
+//
+//   F(2k)   = F(k) * (2*F(k+1) - F(k))
+//   F(2k+1) = F(k)^2 + F(k+1)^2
+//
+// so only O(log m) big multiplications are needed.
+static void fib_bignum(unsigned m, struct bignum *out) {
+  struct bignum a, b, c, d, t;
+  if (bignum_init(&a, 0) != 0 || bignum_init(&b, 1) != 0 || bignum_init(&c, 0) != 0
+      || bignum_init(&d, 0) != 0 || bignum_init(&t, 0) != 0) {
+    err(1, "bignum_init() failed");
+  }
+
+  int bit = 31;
+  while (bit >= 0 && !(m & (1u << bit))) {
+    bit--;
+  }
+  for (; bit >= 0; bit--) {
+    if (bignum_add(&t, &b, &b) != 0 || bignum_sub(&t, &t, &a) != 0
+        || bignum_mul(&c, &a, &t) != 0                       // c = F(2k)
+        || bignum_mul(&t, &a, &a) != 0 || bignum_mul(&d, &b, &b) != 0
+        || bignum_add(&d, &d, &t) != 0) {                    // d = F(2k+1)
+      err(1, "out of memory computing fib");
+    }
+    struct bignum tmp;
+    if (m & (1u << bit)) {
+      // (a, b) = (F(2k+1), F(2k+2)); 'b' gets the old 'a' storage
+      if (bignum_add(&c, &c, &d) != 0) {
+        err(1, "out of memory computing fib");
+      }
+      tmp = a; a = d; d = b; b = c; c = tmp;
+    } else {
+      // (a, b) = (F(2k), F(2k+1))
+      tmp = a; a = c; c = tmp;
+      tmp = b; b = d; d = tmp;
+    }
   }
+
+  *out = a;
+  bignum_free(&b);
+  bignum_free(&c);
+  bignum_free(&d);
+  bignum_free(&t);
 }
 
-// This function converts a line to an integer, computes the
-// corresponding Fibonacci number, then prints the result to the
-// screen.
-void fib_line(const char *line) {
-  int n = atoi(line);
-  int fibn = fib(n);
-  assert(pthread_mutex_lock(&stdout_mutex) == 0);
-  printf("fib(%d) = %d\n", n, fibn);
-  assert(pthread_mutex_unlock(&stdout_mutex) == 0);
+// The Fibonacci function as this program has always defined it:
+// fib(0) = fib(1) = 1, i.e. fib(n) = F(n+1).  Returns a newly
+// allocated decimal string and stores its length in '*len'.
+static char *fib(int n, size_t *len) {
+  struct bignum x;
+  fib_bignum(n < 2 ? 1 : (unsigned)n + 1, &x);
+  char *str = bignum_to_string(&x, len);
+  bignum_free(&x);
+  if (!str) {
+    err(1, "bignum_to_string() failed");
+  }
+  return str;
 }
 
-// Each thread will run this function.  The thread argument is a
-// pointer to a job queue.
-void* worker(void *arg) {
-  struct job_queue *jq = arg;
+// Memo cache shared by all workers, so a repeated input is answered
+// with a lookup.  It is a chained hash table guarded by 'memo_lock'.
+// An entry is inserted as "not ready" before its value is computed, so
+// workers that ask for the same n meanwhile wait instead of computing
+// it again.
+//
+// The cache holds at most MEMO_BUDGET bytes of digits.  Ready entries
+// are kept on a list in least-recently-used order, and the oldest are
+// evicted to make room.  A thread printing a value holds a reference
+// to its entry, so an evicted entry is only freed once the last
+// reference is dropped.  A value larger than the whole budget is not
+// kept at all.
+#define MEMO_BUCKETS (1 << 16)
+#define MEMO_BUDGET (64 << 20)
 
-  while (1) {
-    char *line;
-    if (job_queue_pop(jq, (void**)&line) == 0) {
-      fib_line(line);
-      free(line);
-    } else {
-      // If job_queue_pop() returned non-zero, that means the queue is
-      // being killed (or some other error occured).  In any case,
-      // that means it's time for this thread to die.
-      break;
+struct memo_entry {
+  int n;
+  bool ready;
+  bool cached;             // Still in the table
+  int refs;                // Threads using 'str'
+  char *str;
+  size_t len;
+  struct memo_entry *next; // Hash chain
+  struct memo_entry *newer, *older;  // LRU list, once ready
+};
+
+static struct memo_entry *memo_buckets[MEMO_BUCKETS];
+static struct memo_entry *memo_newest, *memo_oldest;
+static size_t memo_bytes;  // Digits held by cached entries
+static pthread_mutex_t memo_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t memo_ready = PTHREAD_COND_INITIALIZER;
+
+static void memo_destroy(void) {
+  for (int i = 0; i < MEMO_BUCKETS; i++) {
+    struct memo_entry *e = memo_buckets[i];
+    while (e) {
+      struct memo_entry *next = e->next;
+      free(e->str);
+      free(e);
+      e = next;
     }
+    memo_buckets[i] = NULL;
   }
+  memo_newest = memo_oldest = NULL;
+  memo_bytes = 0;
+}
 
-  return NULL;
+static struct memo_entry **memo_bucket(int n) {
+  return &memo_buckets[((unsigned)n * 2654435761u) % MEMO_BUCKETS];
 }
 
-int main(int argc, char * const *argv) {
-  int num_threads = 1;
+// The LRU list functions below must be called with 'memo_lock' held.
+static void lru_unlink(struct memo_entry *e) {
+  *(e->newer ? &e->newer->older : &memo_newest) = e->older;
+  *(e->older ? &e->older->newer : &memo_oldest) = e->newer;
+  e->newer = e->older = NULL;
+}
 
-  if (argc == 3 && strcmp(argv[1], "-n") == 0) {
-    // Since atoi() simply returns zero on syntax errors, we cannot
-    // distinguish between the user entering a zero, or some
-    // non-numeric garbage.  In fact, we cannot even tell whether the
-    // given option is suffixed by garbage, i.e. '123foo' returns
-    // '123'.  A more robust solution would use strtol(), but its
-    // interface is more complicated, so here we are.
-    num_threads = atoi(argv[2]);
-
-    if (num_threads < 1) {
-      err(1, "invalid thread count: %s", argv[2]);
-    }
+static void lru_push(struct memo_entry *e) {
+  e->older = memo_newest;
+  e->newer = NULL;
+  *(memo_newest ? &memo_newest->newer : &memo_oldest) = e;
+  memo_newest = e;
+}
+
+// Take 'e' out of the table (and the LRU list, if it is on it).  It is
+// freed now if nobody uses it, and otherwise by the last memo_put().
+static void memo_drop(struct memo_entry *e) {
+  struct memo_entry **link = memo_bucket(e->n);
+  while (*link != e) {
+    link = &(*link)->next;
   }
+  *link = e->next;
+  if (e->ready) {
+    lru_unlink(e);
+    memo_bytes -= e->len;
+  }
+  e->cached = false;
+  if (e->refs == 0) {
+    free(e->str);
+    free(e);
+  }
+}
+
+// Release a reference taken by memo_get().
+static void memo_put(struct memo_entry *e) {
+  assert(pthread_mutex_lock(&memo_lock) == 0);
+  if (--e->refs == 0 && !e->cached) {
+    free(e->str);
+    free(e);
+  }
+  assert(pthread_mutex_unlock(&memo_lock) == 0);
+}
 
-  // Create job queue.
-  struct job_queue jq;
-  job_queue_init(&jq, 64);
+// Return a reference to the ready entry for fib(n), computing it and
+// caching it on a miss.  Release it with memo_put().
+static struct memo_entry *memo_get(int n) {
+  struct memo_entry **bucket = memo_bucket(n);
 
-  // Start up the worker threads.
-  pthread_t *threads = calloc(num_threads, sizeof(pthread_t));
-  for (int i = 0; i < num_threads; i++) {
-    if (pthread_create(&threads[i], NULL, &worker, &jq) != 0) {
-      err(1, "pthread_create() failed");
+  assert(pthread_mutex_lock(&memo_lock) == 0);
+  struct memo_entry *e = *bucket;
+  while (e && e->n != n) {
+    e = e->next;
+  }
+  if (e) {
+    // Hit: someone may still be computing it
+    e->refs++;
+    while (!e->ready) {
+      pthread_cond_wait(&memo_ready, &memo_lock);
+    }
+    if (e->cached) {
+      lru_unlink(e);
+      lru_push(e);
     }
+    assert(pthread_mutex_unlock(&memo_lock) == 0);
+    return e;
   }
+  // Miss: claim the entry, then compute outside the lock
+  e = calloc(1, sizeof(struct memo_entry));
+  if (!e) {
+    err(1, "calloc() for memo entry failed");
+  }
+  e->n = n;
+  e->cached = true;
+  e->refs = 1;
+  e->next = *bucket;
+  *bucket = e;
+  assert(pthread_mutex_unlock(&memo_lock) == 0);
+
+  size_t len;
+  char *str = fib(n, &len);
 
+  assert(pthread_mutex_lock(&memo_lock) == 0);
+  e->str = str;
+  e->len = len;
+  e->ready = true;
+  pthread_cond_broadcast(&memo_ready);
+  lru_push(e);
+  memo_bytes += len;
+  if (len > MEMO_BUDGET) {
+    memo_drop(e);
+  }
+  // Evict the least recently used entries to make room
+  while (memo_bytes > MEMO_BUDGET) {
+    memo_drop(memo_oldest);
+  }
+  assert(pthread_mutex_unlock(&memo_lock) == 0);
+  return e;
+}
+
+// Parse the integer at the start of a line like atoi() does, except
+// that leading whitespace never runs on into the next line.
+static int parse_line(const char *line) {
+  while (*line == ' ' || *line == '\t' || *line == '\r') {
+    line++;
+  }
+  return *line == '\n' ? 0 : atoi(line);
+}
+
+// This function converts a line to an integer, computes the
+// corresponding Fibonacci number, then prints the result to the
+// batch's output.
+void fib_line(const char *line, FILE *out) {
+  int n = parse_line(line);
+  struct memo_entry *e = memo_get(n);
+  fprintf(out, "fib(%d) = ", n);
+  // A ready entry never changes, so it can be printed without the lock
+  fwrite(e->str, 1, e->len, out);
+  fputc('\n', out);
+  memo_put(e);
+}
 
-  // Now read lines from stdin until EOF.
-  char *line = NULL;
-  ssize_t line_len;
-  size_t buf_len = 0;
-  while ((line_len = getline(&line, &buf_len, stdin)) != -1) {
-    job_queue_push(&jq, (void*)strdup(line));
+// Run every line of a batch through fib_line().  Lines are not copied:
+// parsing stops at the newline, and the block is '\0'-terminated after
+// the final line.
+static void fib_batch(struct line_batch *b, void *arg) {
+  (void)arg;
+  struct output *o = malloc(sizeof(struct output));
+  FILE *out = o ? open_memstream(&o->buf, &o->len) : NULL;
+  if (!out) {
+    err(1, "open_memstream() failed");
+  }
+  const char *p = b->chunk.start;
+  const char *end = p + b->chunk.len;
+  while (p < end) {
+    fib_line(p, out);
+    const char *nl = memchr(p, '\n', (size_t)(end - p));
+    p = nl ? nl + 1 : end;
   }
-  free(line);
+  fclose(out);
+  b->result = o;
+}
 
-  // Destroy the queue.
-  job_queue_destroy(&jq);
+// Print a finished batch.  Batches arrive in input order.
+static void print_batch(struct line_batch *b, FILE *out, void *arg) {
+  (void)arg;
+  struct output *o = b->result;
+  fwrite(o->buf, 1, o->len, out);
+  free(o->buf);
+  free(o);
+}
+
+int main(int argc, char * const *argv) {
+  int num_threads = 1;
+  enum pin_mode pin = PIN_NONE;
 
-  // Wait for all threads to finish.  This is important, at some may
-  // still be working on their job.
-  for (int i = 0; i < num_threads; i++) {
-    if (pthread_join(threads[i], NULL) != 0) {
-      err(1, "pthread_join() failed");
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      // "auto" sizes the pool from the CPUs we are actually allowed
+      // to use (affinity mask and cgroup quota), not just nproc.
+      num_threads = parse_thread_count(argv[++i]);
+
+      if (num_threads < 1) {
+        err(1, "invalid thread count: %s", argv[i]);
+      }
+    } else if (parse_pin_mode(argv[i], &pin) != 0) {
+      err(1, "usage: [-n INT|auto] [--pin[=spread|compact]]");
     }
   }
-  free(threads);
+
+  struct cpu_plan plan;
+  if (cpu_plan_init(&plan, pin) != 0) {
+    err(1, "cpu_plan_init() failed");
+  }
+
+  // Read stdin in blocks until EOF and hand out one batch per job; a
+  // writer thread prints the results in input order.
+  struct line_pipeline pipeline = {
+    .fd = STDIN_FILENO,
+    .block_size = BLOCK_SIZE,
+    .chunk_size = BATCH_SIZE,
+    .max_pending = MAX_PENDING,
+    .num_threads = num_threads,
+    .plan = &plan,
+    .work = fib_batch,
+    .emit = print_batch,
+    .arg = NULL,
+    .out = stdout
+  };
+  int failed = line_pipeline_run(&pipeline);
+  if (failed) {
+    warn("failed to read stdin");
+  }
+
+  cpu_plan_destroy(&plan);
+  memo_destroy();
+  return failed ? 1 : 0;
 }
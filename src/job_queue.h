@@ -17,9 +17,11 @@ struct job_queue {
   pthread_cond_t not_empty;
 };
 
+struct search;
+
 struct worker {
   struct job_queue *jq;
-  const char *needle;
+  const struct search *search;
 };
 
 // Initialise a job queue with the given capacity.  The queue starts out
@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <err.h>
+#include <pthread.h>
+#include "job_queue.h"
+#include "line_pipeline.h"
+
+// Shared by the reader, the workers and the writer of one run.  Every
+// batch is pushed onto the output queue before the job queue, so the
+// writer sees batches in input order and waits on 'done_cond' for the
+// one it needs next.
+struct pipeline_state {
+  const struct line_pipeline *p;
+  struct job_queue jq;
+  struct job_queue outq;
+  pthread_mutex_t done_mutex;
+  pthread_cond_t done_cond;
+  size_t queued;           // Batches pushed onto 'outq' so far
+};
+
+static void* pipeline_worker(void *arg) {
+  struct pipeline_state *s = arg;
+
+  for (;;) {
+    struct line_batch *b = NULL;
+    if (job_queue_pop(&s->jq, (void**)&b) != 0 || b == NULL) {
+      break; // pop failed/queue error or shutdown
+    }
+    s->p->work(b, s->p->arg);
+
+    assert(pthread_mutex_lock(&s->done_mutex) == 0);
+    b->done = true;
+    pthread_cond_broadcast(&s->done_cond);
+    assert(pthread_mutex_unlock(&s->done_mutex) == 0);
+  }
+  return NULL;
+}
+
+// Emit batches in input order as they complete.  A NULL batch marks
+// the end of the input.
+static void* pipeline_writer(void *arg) {
+  struct pipeline_state *s = arg;
+  size_t emitted = 0;
+
+  for (;;) {
+    struct line_batch *b = NULL;
+    if (job_queue_pop(&s->outq, (void**)&b) != 0 || b == NULL) {
+      break;
+    }
+    assert(pthread_mutex_lock(&s->done_mutex) == 0);
+    while (!b->done) {
+      pthread_cond_wait(&s->done_cond, &s->done_mutex);
+    }
+    assert(pthread_mutex_unlock(&s->done_mutex) == 0);
+
+    s->p->emit(b, s->p->out, s->p->arg);
+    line_chunk_release(&b->chunk);
+    free(b);
+
+    // Nothing else has been read yet: the input may be slow, so show
+    // what we have rather than leave it in the buffer
+    if (++emitted == __atomic_load_n(&s->queued, __ATOMIC_ACQUIRE)) {
+      fflush(s->p->out);
+    }
+  }
+  fflush(s->p->out);
+  return NULL;
+}
+
+int line_pipeline_run(const struct line_pipeline *p) {
+  struct pipeline_state s = { .p = p, .queued = 0 };
+  if (job_queue_init(&s.jq, p->max_pending) != 0
+      || job_queue_init(&s.outq, p->max_pending) != 0) {
+    err(1, "job_queue_init() failed");
+  }
+  pthread_mutex_init(&s.done_mutex, NULL);
+  pthread_cond_init(&s.done_cond, NULL);
+
+  pthread_t *threads = calloc((size_t)p->num_threads, sizeof(pthread_t));
+  if (!threads) {
+    err(1, "calloc() for threads failed");
+  }
+  for (int i = 0; i < p->num_threads; i++) {
+    pthread_attr_t attr;
+    if (cpu_plan_attr(p->plan, i, &attr) != 0) {
+      err(1, "cpu_plan_attr() failed");
+    }
+    if (pthread_create(&threads[i], &attr, pipeline_worker, &s) != 0) {
+      err(1, "pthread_create() failed");
+    }
+    pthread_attr_destroy(&attr);
+  }
+  pthread_t writer_thread;
+  if (pthread_create(&writer_thread, NULL, pipeline_writer, &s) != 0) {
+    err(1, "pthread_create() failed");
+  }
+
+  // Read the input and hand out one batch per chunk
+  int failed = 0;
+  struct line_reader reader;
+  if (line_reader_init(&reader, p->fd, p->block_size, p->chunk_size) != 0) {
+    failed = 1;
+  } else {
+    int r;
+    struct line_chunk chunk;
+    while ((r = line_reader_next(&reader, &chunk)) == 1) {
+      struct line_batch *b = calloc(1, sizeof(struct line_batch));
+      if (!b) {
+        err(1, "calloc() for batch failed");
+      }
+      b->chunk = chunk;
+      __atomic_add_fetch(&s.queued, 1, __ATOMIC_RELEASE);
+      job_queue_push(&s.outq, b);
+      job_queue_push(&s.jq, b);
+    }
+    failed = r < 0;
+    line_reader_destroy(&reader);
+  }
+  job_queue_push(&s.outq, NULL);
+
+  // Input done - signal workers to stop
+  for (int i = 0; i < p->num_threads; i++) {
+    job_queue_push(&s.jq, NULL);
+  }
+  for (int i = 0; i < p->num_threads; i++) {
+    if (pthread_join(threads[i], NULL) != 0) {
+      err(1, "pthread_join() failed");
+    }
+  }
+  free(threads);
+  if (pthread_join(writer_thread, NULL) != 0) {
+    err(1, "pthread_join() failed");
+  }
+  job_queue_destroy(&s.jq);
+  job_queue_destroy(&s.outq);
+  pthread_mutex_destroy(&s.done_mutex);
+  pthread_cond_destroy(&s.done_cond);
+  return failed;
+}
@@ -0,0 +1,47 @@
+#ifndef LINE_PIPELINE_H
+#define LINE_PIPELINE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "line_reader.h"
+#include "cpu_affinity.h"
+
+// Ordered parallel processing of line-oriented input.  The calling
+// thread cuts the input into chunks of whole lines (see line_reader.h),
+// a pool of worker threads runs 'work' on each chunk, and a writer
+// thread calls 'emit' on the chunks in input order as they complete.
+
+// One chunk on its way through the pipeline.
+struct line_batch {
+  struct line_chunk chunk;
+  void *result;            // Whatever 'work' leaves for 'emit'
+  bool done;               // Set once 'work' has returned
+};
+
+struct line_pipeline {
+  int fd;                  // Input
+  size_t block_size;       // See line_reader_init()
+  size_t chunk_size;
+  int max_pending;         // Chunks in flight at once; bounds memory use
+  int num_threads;
+  const struct cpu_plan *plan;  // Where worker i runs: cpu_plan_attr(plan, i)
+
+  // Process a chunk, leaving the outcome in 'batch->result'.  Called
+  // from the worker threads, in any order.
+  void (*work)(struct line_batch *batch, void *arg);
+
+  // Write the outcome of a chunk to 'out' and free 'batch->result'.
+  // Called from the writer thread, in input order.  The chunk stays
+  // valid until 'emit' returns.
+  void (*emit)(struct line_batch *batch, FILE *out, void *arg);
+
+  void *arg;               // Passed to 'work' and 'emit'
+  FILE *out;               // Flushed whenever the writer has caught up
+};
+
+// Run the pipeline until the input ends.  Returns non-zero if reading
+// failed; everything read up to that point is still processed.  Exits
+// the program if a thread cannot be started.
+int line_pipeline_run(const struct line_pipeline *p);
+
+#endif
@@ -0,0 +1,185 @@
+// Setting _GNU_SOURCE is necessary for memrchr().
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include "line_reader.h"
+
+static void block_release(struct line_block *block) {
+  if (block && __atomic_sub_fetch(&block->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+    free(block->data);
+    free(block);
+  }
+}
+
+// A single read() into 'buf'.  Returns the number of bytes read, 0 at
+// end of input, or -1 on error.
+static ssize_t read_some(int fd, char *buf, size_t size) {
+  for (;;) {
+    ssize_t n = read(fd, buf, size);
+    if (n >= 0 || errno != EINTR) {
+      return n;
+    }
+  }
+}
+
+// Whether more input can be read without blocking.
+static bool readable(int fd) {
+  struct pollfd p = { .fd = fd, .events = POLLIN };
+  return poll(&p, 1, 0) > 0;
+}
+
+// Make room for more input in a full block.  A block that nothing has
+// been cut from yet can simply grow; otherwise chunks may point into
+// it, so its unconsumed tail (a partial line) is moved to the start of
+// a new block.  Returns non-zero on error.
+static int make_room(struct line_reader *reader) {
+  struct line_block *old = reader->cur;
+  if (old && reader->pos == 0) {
+    size_t size = 2*reader->cap;
+    char *bigger = realloc(old->data, size + 1);
+    if (!bigger) {
+      return -1;
+    }
+    old->data = bigger;
+    reader->cap = size;
+    return 0;
+  }
+
+  size_t carry = old ? old->len - reader->pos : 0;
+  size_t size = reader->block_size;
+  while (size < 2*carry) {
+    size *= 2;
+  }
+  struct line_block *block = malloc(sizeof(struct line_block));
+  char *data = malloc(size + 1);
+  if (!block || !data) {
+    free(block);
+    free(data);
+    return -1;
+  }
+  if (carry) {
+    memcpy(data, old->data + reader->pos, carry);
+  }
+  block->data = data;
+  block->len = carry;
+  block->refs = 1;
+  block_release(old);
+  reader->cur = block;
+  reader->cap = size;
+  reader->pos = 0;
+  reader->end = 0;
+  return 0;
+}
+
+// Read more input after the end of the current block, until it holds
+// at least one whole line that has not been handed out yet.  Input
+// that is already waiting is read as well, up to a chunk's worth, but
+// we never block once a line is complete: an interactive or slow
+// producer gets each line processed as soon as it arrives.  Returns 1
+// if there is something to hand out, 0 at end of input, -1 on error.
+static int fill(struct line_reader *reader) {
+  for (;;) {
+    struct line_block *block = reader->cur;
+    size_t scanned = block ? block->len : 0;  // Searched for newlines already
+    if (!reader->eof) {
+      if (!block || block->len == reader->cap) {
+        if (make_room(reader) != 0) {
+          return -1;
+        }
+        block = reader->cur;
+        scanned = block->len;
+      }
+      ssize_t n = read_some(reader->fd, block->data + block->len, reader->cap - block->len);
+      if (n < 0) {
+        return -1;
+      }
+      if (n == 0) {
+        reader->eof = true;
+      }
+      block->len += (size_t)n;
+    }
+    // Chunks already handed out end at a newline, so overwriting the
+    // old terminator here does not affect them
+    block->data[block->len] = '\0';
+
+    if (reader->eof) {
+      // Everything left is handed out, including a final line that
+      // lacks its newline
+      reader->end = block->len;
+      return reader->end > reader->pos;
+    }
+    // Only the new bytes need searching: anything before them up to
+    // 'end' is whole lines, and the rest is a partial line.  This keeps
+    // a long line arriving in many small reads linear.
+    char *nl = memrchr(block->data + scanned, '\n', block->len - scanned);
+    if (nl) {
+      reader->end = (size_t)(nl - block->data) + 1;
+    }
+    if (reader->end > reader->pos
+        && (reader->end - reader->pos >= reader->chunk_size || block->len == reader->cap
+            || !readable(reader->fd))) {
+      return 1;
+    }
+  }
+}
+
+int line_reader_init(struct line_reader *reader, int fd,
+                     size_t block_size, size_t chunk_size) {
+  if (block_size == 0 || chunk_size == 0) {
+    return -1;
+  }
+  reader->fd = fd;
+  reader->block_size = block_size;
+  reader->chunk_size = chunk_size;
+  reader->cur = NULL;
+  reader->cap = 0;
+  reader->pos = 0;
+  reader->end = 0;
+  reader->eof = false;
+  return 0;
+}
+
+void line_reader_destroy(struct line_reader *reader) {
+  block_release(reader->cur);
+  reader->cur = NULL;
+}
+
+int line_reader_next(struct line_reader *reader, struct line_chunk *chunk) {
+  if (!reader->cur || reader->pos == reader->end) {
+    if (reader->cur && reader->eof) {
+      return 0;
+    }
+    int r = fill(reader);
+    if (r <= 0) {
+      return r;
+    }
+  }
+  struct line_block *block = reader->cur;
+  size_t start = reader->pos;
+  size_t stop = reader->end;
+
+  // Cut after the first newline at or beyond the target size
+  if (stop - start > reader->chunk_size) {
+    char *from = block->data + start + reader->chunk_size - 1;
+    char *nl = memchr(from, '\n', stop - (start + reader->chunk_size - 1));
+    if (nl) {
+      stop = (size_t)(nl - block->data) + 1;
+    }
+  }
+  reader->pos = stop;
+
+  __atomic_add_fetch(&block->refs, 1, __ATOMIC_RELAXED);
+  chunk->block = block;
+  chunk->start = block->data + start;
+  chunk->len = stop - start;
+  return 1;
+}
+
+void line_chunk_release(struct line_chunk *chunk) {
+  block_release(chunk->block);
+  chunk->block = NULL;
+}
@@ -0,0 +1,57 @@
+#ifndef LINE_READER_H
+#define LINE_READER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// A block of input read in one go.  Chunks point into it rather than
+// copying lines out, so it is reference counted and freed when the
+// reader and the last chunk have let go of it.  'data[len]' is always
+// '\0', so the final line can be parsed even without a newline.
+struct line_block {
+  char *data;
+  size_t len;
+  int refs;
+};
+
+// A run of whole lines inside a block.  Every line except possibly
+// the very last one of the input ends in '\n'.
+struct line_chunk {
+  struct line_block *block;
+  const char *start;
+  size_t len;
+};
+
+struct line_reader {
+  int fd;
+  size_t block_size;       // Bytes read per block
+  size_t chunk_size;       // Target bytes per chunk
+  struct line_block *cur;  // Block being filled and cut into chunks
+  size_t cap;              // Bytes 'cur' has room for
+  size_t pos;              // Next unconsumed byte in 'cur'
+  size_t end;              // End of the last whole line in 'cur'
+  bool eof;
+};
+
+// Initialise a reader on the file descriptor 'fd'.  Input is read
+// into blocks of 'block_size' bytes and cut into chunks of roughly
+// 'chunk_size' bytes, always at a line boundary.  A chunk is handed
+// out as soon as whole lines are available, without waiting for the
+// block to fill.  Returns non-zero on error.
+int line_reader_init(struct line_reader *reader, int fd,
+                     size_t block_size, size_t chunk_size);
+
+// Release the reader's own reference to the current block.  Chunks
+// already handed out remain valid.
+void line_reader_destroy(struct line_reader *reader);
+
+// Fetch the next chunk.  Returns 1 if a chunk was stored in '*chunk',
+// 0 at end of input, and -1 on error.  Lines longer than a block are
+// handled by growing the block.
+int line_reader_next(struct line_reader *reader, struct line_chunk *chunk);
+
+// Drop the chunk's reference to its block.  Safe to call from any
+// thread.
+void line_chunk_release(struct line_chunk *chunk);
+
+#endif
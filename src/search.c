@@ -0,0 +1,127 @@
+// Setting _GNU_SOURCE is necessary for memmem().
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <stdint.h>
+#include "search.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static unsigned char fold(unsigned char c) {
+  return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static bool is_letter(unsigned char c) {
+  return fold(c) >= 'a' && fold(c) <= 'z';
+}
+
+static bool is_word(unsigned char c) {
+  return c == '_' || is_letter(c) || (c >= '0' && c <= '9');
+}
+
+void search_init(struct search *s, const char *needle, bool icase, bool word) {
+  s->needle = needle;
+  s->len = strlen(needle);
+  s->icase = icase;
+  s->word = word;
+  s->first = s->last = 0;
+  s->first_or = s->last_or = 0;
+  if (s->len > 0) {
+    unsigned char first = (unsigned char)needle[0];
+    unsigned char last = (unsigned char)needle[s->len - 1];
+    s->first = icase ? fold(first) : first;
+    s->last = icase ? fold(last) : last;
+    // ORing 0x20 lowercases an ASCII letter, and for a letter only its
+    // two cases map to the same value, so the filter stays exact
+    s->first_or = (icase && is_letter(first)) ? 0x20 : 0;
+    s->last_or = (icase && is_letter(last)) ? 0x20 : 0;
+  }
+}
+
+// -w: the match at 'pos' must not be preceded or followed by a word
+// character
+static bool at_word_boundary(const struct search *s, const char *hay, size_t len, size_t pos) {
+  return (pos == 0 || !is_word((unsigned char)hay[pos - 1]))
+      && (pos + s->len == len || !is_word((unsigned char)hay[pos + s->len]));
+}
+
+// Full check of a candidate position
+static bool verify(const struct search *s, const char *hay, size_t len, size_t pos) {
+  const unsigned char *h = (const unsigned char*)hay + pos;
+  const unsigned char *n = (const unsigned char*)s->needle;
+  for (size_t i = 0; i < s->len; i++) {
+    if (fold(h[i]) != fold(n[i])) {
+      return false;
+    }
+  }
+  return !s->word || at_word_boundary(s, hay, len, pos);
+}
+
+// Byte-at-a-time case-insensitive search from position 'from'
+static const char *find_icase_scalar(const struct search *s, const char *hay, size_t len, size_t from) {
+  for (size_t pos = from; pos + s->len <= len; pos++) {
+    if (((unsigned char)hay[pos] | s->first_or) == s->first && verify(s, hay, len, pos)) {
+      return hay + pos;
+    }
+  }
+  return NULL;
+}
+
+// Case-insensitive search, 16 positions at a time.  A position is a
+// candidate if both its first and last needle bytes match after
+// folding; only candidates are compared in full.
+static const char *find_icase(const struct search *s, const char *hay, size_t len) {
+  size_t pos = 0;
+#ifdef __SSE2__
+  const __m128i first = _mm_set1_epi8((char)s->first);
+  const __m128i last = _mm_set1_epi8((char)s->last);
+  const __m128i first_or = _mm_set1_epi8((char)s->first_or);
+  const __m128i last_or = _mm_set1_epi8((char)s->last_or);
+
+  for (; pos + s->len - 1 + 16 <= len; pos += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(hay + pos));
+    __m128i b = _mm_loadu_si128((const __m128i*)(hay + pos + s->len - 1));
+    __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(a, first_or), first),
+                               _mm_cmpeq_epi8(_mm_or_si128(b, last_or), last));
+    unsigned bits = (unsigned)_mm_movemask_epi8(eq);
+    while (bits) {
+      size_t cand = pos + (size_t)__builtin_ctz(bits);
+      if (verify(s, hay, len, cand)) {
+        return hay + cand;
+      }
+      bits &= bits - 1;
+    }
+  }
+#endif
+  return find_icase_scalar(s, hay, len, pos);
+}
+
+// Case-sensitive search: memmem() is already vectorized, so -w only
+// adds a boundary check on each hit
+static const char *find_exact(const struct search *s, const char *hay, size_t len) {
+  size_t pos = 0;
+  while (pos + s->len <= len) {
+    const char *hit = memmem(hay + pos, len - pos, s->needle, s->len);
+    if (!hit) {
+      return NULL;
+    }
+    size_t at = (size_t)(hit - hay);
+    if (!s->word || at_word_boundary(s, hay, len, at)) {
+      return hit;
+    }
+    pos = at + 1;
+  }
+  return NULL;
+}
+
+const char *search_find(const struct search *s, const char *hay, size_t len) {
+  if (s->len == 0) {
+    return hay;
+  }
+  if (s->len > len) {
+    return NULL;
+  }
+  return s->icase ? find_icase(s, hay, len) : find_exact(s, hay, len);
+}
@@ -0,0 +1,27 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A substring search with fauxgrep's matching options.
+struct search {
+  const char *needle;
+  size_t len;
+  bool icase;              // -i: ASCII letters match either case
+  bool word;               // -w: match must not touch a word character
+  unsigned char first;     // First and last needle bytes, lowercased
+  unsigned char last;      // if 'icase'
+  unsigned char first_or;  // 0x20 if 'first' is a letter and 'icase',
+  unsigned char last_or;   // likewise for 'last'; else 0
+};
+
+// Prepare a search for 'needle', which must outlive it.
+void search_init(struct search *s, const char *needle, bool icase, bool word);
+
+// Return the first match in 'hay[0..len)', or NULL.  'hay' need not be
+// '\0'-terminated.  For -w, the ends of 'hay' count as word
+// boundaries, so pass one line at a time.
+const char *search_find(const struct search *s, const char *hay, size_t len);
+
+#endif
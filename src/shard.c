@@ -0,0 +1,165 @@
+// Setting _DEFAULT_SOURCE is necessary for MAP_ANONYMOUS, syscall() and
+// strdup().
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <fts.h>
+#include <linux/futex.h>
+#include "shard.h"
+
+int shard_fork(int nprocs, pid_t *pids) {
+  // Anything buffered now would otherwise be printed once per child
+  fflush(stdout);
+  fflush(stderr);
+  for (int i = 0; i < nprocs; i++) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      return -2;
+    }
+    if (pid == 0) {
+      return i;
+    }
+    pids[i] = pid;
+  }
+  return -1;
+}
+
+static bool child_failed(int status) {
+  return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+int shard_wait(pid_t *pids, int nprocs) {
+  int failed = 0;
+  int running = nprocs;
+  while (running > 0) {
+    int status;
+    pid_t pid = wait(&status);
+    if (pid < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    for (int i = 0; i < nprocs; i++) {
+      if (pids[i] == pid) {
+        pids[i] = 0;
+        running--;
+      }
+    }
+    if (child_failed(status) && !failed) {
+      // The others may be waiting for a turn the failed child held
+      failed = 1;
+      for (int i = 0; i < nprocs; i++) {
+        if (pids[i] > 0) {
+          kill(pids[i], SIGTERM);
+        }
+      }
+    }
+  }
+  return failed;
+}
+
+int shard_poll(pid_t *pids, int nprocs, int *failed) {
+  int running = 0;
+  for (int i = 0; i < nprocs; i++) {
+    if (pids[i] <= 0) {
+      continue;
+    }
+    int status;
+    pid_t r = waitpid(pids[i], &status, WNOHANG);
+    if (r == 0) {
+      running++;
+    } else {
+      *failed |= r < 0 || child_failed(status);
+      pids[i] = 0;
+    }
+  }
+  return running;
+}
+
+int shard_files_collect(struct shard_files *files, char * const *paths) {
+  files->paths = NULL;
+  files->count = 0;
+  files->cap = 0;
+
+  FTS *ftsp = fts_open(paths, FTS_LOGICAL | FTS_NOCHDIR, NULL);
+  if (ftsp == NULL) {
+    return -1;
+  }
+  FTSENT *p;
+  while ((p = fts_read(ftsp)) != NULL) {
+    if (p->fts_info != FTS_F) {
+      continue;
+    }
+    if (files->count == files->cap) {
+      size_t cap = files->cap ? 2*files->cap : 1024;
+      char **grown = realloc(files->paths, sizeof(char*) * cap);
+      if (!grown) {
+        break;
+      }
+      files->paths = grown;
+      files->cap = cap;
+    }
+    // strdup() because FTS reuses internal buffers
+    if ((files->paths[files->count] = strdup(p->fts_path)) == NULL) {
+      break;
+    }
+    files->count++;
+  }
+  fts_close(ftsp);
+  if (p != NULL) {
+    shard_files_free(files);
+    return -1;
+  }
+  return 0;
+}
+
+void shard_files_free(struct shard_files *files) {
+  for (size_t i = 0; i < files->count; i++) {
+    free(files->paths[i]);
+  }
+  free(files->paths);
+  files->paths = NULL;
+  files->count = 0;
+  files->cap = 0;
+}
+
+size_t shard_claim(uint32_t *next) {
+  return __atomic_fetch_add(next, 1, __ATOMIC_RELAXED);
+}
+
+void *shard_shm_alloc(size_t size) {
+  void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  return mem == MAP_FAILED ? NULL : mem;
+}
+
+void shard_shm_free(void *mem, size_t size) {
+  munmap(mem, size);
+}
+
+// The turn counter lives in shared memory, so the futex must not be
+// FUTEX_PRIVATE.
+void shard_turn_wait(uint32_t *turn, uint32_t ticket) {
+  for (;;) {
+    uint32_t cur = __atomic_load_n(turn, __ATOMIC_ACQUIRE);
+    if (cur == ticket) {
+      return;
+    }
+    // Sleeps only if the counter still holds 'cur'
+    syscall(SYS_futex, turn, FUTEX_WAIT, cur, NULL, NULL, 0);
+  }
+}
+
+void shard_turn_advance(uint32_t *turn) {
+  __atomic_add_fetch(turn, 1, __ATOMIC_RELEASE);
+  syscall(SYS_futex, turn, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
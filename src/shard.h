@@ -0,0 +1,66 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Support for splitting a traversal over several worker processes
+// ("shards").  The parent walks the paths once, before forking, so
+// every shard inherits the same list of files.  Shards then claim
+// files from it through a counter in shared memory, and results are
+// combined through memory shared between the processes as well.
+
+// The regular files found by one traversal, in traversal order.  The
+// index of a file in the list is its ticket (see shard_turn_wait()).
+struct shard_files {
+  char **paths;
+  size_t count;
+  size_t cap;
+};
+
+// Fork 'nprocs' child processes.  In each child, returns the index of
+// its shard (0 to nprocs-1).  In the parent, stores the children's
+// pids in 'pids' and returns -1, or -2 if fork() failed.  Call before
+// any threads are started.
+int shard_fork(int nprocs, pid_t *pids);
+
+// Wait for all children.  Returns non-zero if any of them failed, in
+// which case the rest are killed, as they may be waiting for a turn
+// that will never come.
+int shard_wait(pid_t *pids, int nprocs);
+
+// Like shard_wait(), but only reaps children that have already
+// exited.  Returns the number still running.
+int shard_poll(pid_t *pids, int nprocs, int *failed);
+
+// Collect the regular files under 'paths' with FTS.  Returns non-zero
+// on error.
+int shard_files_collect(struct shard_files *files, char * const *paths);
+
+// Free the list.
+void shard_files_free(struct shard_files *files);
+
+// Claim the next file of the list for this shard.  '*next' is a
+// counter in shared memory, zero before the first claim.  Returns the
+// file's index, which is at least the list's count once every file
+// has been claimed.  Each index is handed out exactly once.
+size_t shard_claim(uint32_t *next);
+
+// Allocate zeroed memory that is shared with children forked later.
+// Returns NULL on error.
+void *shard_shm_alloc(size_t size);
+
+// Release memory from shard_shm_alloc().
+void shard_shm_free(void *mem, size_t size);
+
+// Block until the shared counter '*turn' equals 'ticket'.  Used to
+// print results in traversal order: ticket i belongs to the i-th file,
+// and as every file is claimed once, every ticket gets its turn.
+void shard_turn_wait(uint32_t *turn, uint32_t ticket);
+
+// Pass the turn on to the next ticket and wake all waiters.
+void shard_turn_advance(uint32_t *turn);
+
+#endif
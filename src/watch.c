@@ -0,0 +1,203 @@
+// Setting _DEFAULT_SOURCE is necessary for pread() and strdup().
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "watch.h"
+
+#define WATCH_BUCKETS 4096
+#define FINGERPRINT_WINDOW 4096
+#define FINGERPRINT_WINDOWS 16
+
+// Events we care about in a watched directory
+#define DIR_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE \
+                    | IN_MOVED_FROM | IN_MOVED_TO)
+
+// FNV-1a, 64-bit
+static uint64_t hash_bytes(const void *data, size_t len, uint64_t h) {
+  const unsigned char *p = data;
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ p[i]) * 1099511628211u;
+  }
+  return h;
+}
+
+static size_t bucket_of(const struct watch *w, const char *path) {
+  return hash_bytes(path, strlen(path), 14695981039346656037u) % w->nbuckets;
+}
+
+int watch_init(struct watch *w) {
+  w->fd = inotify_init1(IN_CLOEXEC);
+  if (w->fd < 0) {
+    return -1;
+  }
+  w->wd_paths = NULL;
+  w->wd_tree = NULL;
+  w->wd_cap = 0;
+  w->nbuckets = WATCH_BUCKETS;
+  w->buckets = calloc(w->nbuckets, sizeof(struct watch_file*));
+  if (!w->buckets) {
+    close(w->fd);
+    return -1;
+  }
+  pthread_mutex_init(&w->lock, NULL);
+  return 0;
+}
+
+void watch_destroy(struct watch *w) {
+  for (size_t i = 0; i < w->nbuckets; i++) {
+    struct watch_file *e = w->buckets[i];
+    while (e) {
+      struct watch_file *next = e->next;
+      free(e->path);
+      free(e);
+      e = next;
+    }
+  }
+  free(w->buckets);
+  for (int i = 0; i < w->wd_cap; i++) {
+    free(w->wd_paths[i]);
+  }
+  free(w->wd_paths);
+  free(w->wd_tree);
+  pthread_mutex_destroy(&w->lock);
+  close(w->fd);
+}
+
+int watch_add(struct watch *w, const char *path, bool tree) {
+  int wd = inotify_add_watch(w->fd, path, DIR_EVENTS);
+  if (wd < 0) {
+    return -1;
+  }
+  if (wd >= w->wd_cap) {
+    int cap = w->wd_cap ? w->wd_cap : 64;
+    while (cap <= wd) {
+      cap *= 2;
+    }
+    char **paths = realloc(w->wd_paths, sizeof(char*) * (size_t)cap);
+    if (!paths) {
+      return -1;
+    }
+    w->wd_paths = paths;
+    bool *trees = realloc(w->wd_tree, sizeof(bool) * (size_t)cap);
+    if (!trees) {
+      return -1;
+    }
+    w->wd_tree = trees;
+    memset(paths + w->wd_cap, 0, sizeof(char*) * (size_t)(cap - w->wd_cap));
+    memset(trees + w->wd_cap, 0, sizeof(bool) * (size_t)(cap - w->wd_cap));
+    w->wd_cap = cap;
+  }
+  // Adding the same directory twice returns the same descriptor.  Keep
+  // the path it was traversed under, as file paths are built from it.
+  if (w->wd_paths[wd] && (w->wd_tree[wd] || !tree)) {
+    return wd;
+  }
+  free(w->wd_paths[wd]);
+  w->wd_paths[wd] = strdup(path);
+  w->wd_tree[wd] = tree;
+  return w->wd_paths[wd] ? wd : -1;
+}
+
+const char *watch_path(const struct watch *w, int wd) {
+  return (wd >= 0 && wd < w->wd_cap) ? w->wd_paths[wd] : NULL;
+}
+
+bool watch_is_tree(const struct watch *w, int wd) {
+  return wd >= 0 && wd < w->wd_cap && w->wd_tree[wd];
+}
+
+void watch_remove(struct watch *w, int wd) {
+  if (wd >= 0 && wd < w->wd_cap) {
+    free(w->wd_paths[wd]);
+    w->wd_paths[wd] = NULL;
+    w->wd_tree[wd] = false;
+  }
+}
+
+struct watch_file *watch_file_get(struct watch *w, const char *path, bool create) {
+  size_t b = bucket_of(w, path);
+  pthread_mutex_lock(&w->lock);
+  struct watch_file *e = w->buckets[b];
+  while (e && strcmp(e->path, path) != 0) {
+    e = e->next;
+  }
+  if (!e && create) {
+    e = calloc(1, sizeof(struct watch_file));
+    if (e && !(e->path = strdup(path))) {
+      free(e);
+      e = NULL;
+    }
+    if (e) {
+      e->next = w->buckets[b];
+      w->buckets[b] = e;
+    }
+  }
+  pthread_mutex_unlock(&w->lock);
+  return e;
+}
+
+// Whether 'path' is 'dir' itself or lies below it
+static bool below(const char *path, const char *dir) {
+  size_t n = strlen(dir);
+  return strncmp(path, dir, n) == 0 && (path[n] == '\0' || path[n] == '/');
+}
+
+void watch_file_remove(struct watch *w, const char *path, bool prefix,
+                       void (*forget)(struct watch_file *)) {
+  pthread_mutex_lock(&w->lock);
+  // A single path lives in one bucket; a directory's files anywhere
+  size_t first = prefix ? 0 : bucket_of(w, path);
+  size_t last = prefix ? w->nbuckets : first + 1;
+  for (size_t b = first; b < last; b++) {
+    struct watch_file **link = &w->buckets[b];
+    while (*link) {
+      struct watch_file *e = *link;
+      if (prefix ? below(e->path, path) : strcmp(e->path, path) == 0) {
+        *link = e->next;
+        forget(e);
+        free(e->path);
+        free(e);
+      } else {
+        link = &e->next;
+      }
+    }
+  }
+  pthread_mutex_unlock(&w->lock);
+}
+
+// Add 'len' bytes of 'fd' from 'start' to the hash 'h'
+static uint64_t hash_range(int fd, off_t start, size_t len, uint64_t h) {
+  char buf[FINGERPRINT_WINDOW];
+  while (len > 0) {
+    size_t want = len < sizeof buf ? len : sizeof buf;
+    ssize_t n = pread(fd, buf, want, start);
+    if (n <= 0) {
+      break;
+    }
+    h = hash_bytes(buf, (size_t)n, h);
+    start += n;
+    len -= (size_t)n;
+  }
+  return h;
+}
+
+uint64_t watch_fingerprint(int fd, off_t offset) {
+  uint64_t h = 14695981039346656037u ^ (uint64_t)offset;
+  off_t all = (off_t)FINGERPRINT_WINDOW * FINGERPRINT_WINDOWS;
+  if (offset <= all) {
+    return hash_range(fd, 0, (size_t)offset, h);
+  }
+  // The first window starts at 0 and the last one ends at 'offset'
+  off_t span = offset - FINGERPRINT_WINDOW;
+  for (int i = 0; i < FINGERPRINT_WINDOWS; i++) {
+    off_t start = span / (FINGERPRINT_WINDOWS - 1) * i;
+    if (i == FINGERPRINT_WINDOWS - 1) {
+      start = span;
+    }
+    h = hash_range(fd, start, FINGERPRINT_WINDOW, h);
+  }
+  return h;
+}
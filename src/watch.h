@@ -0,0 +1,73 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+// What fhistogram remembers about a file it has counted, so that a
+// later change only costs the changed bytes.
+struct watch_file {
+  char *path;
+  off_t offset;            // Bytes counted so far
+  uint64_t fingerprint;    // watch_fingerprint() of those bytes
+  struct timespec mtime;   // Modification time when they were counted
+  int bits[8];             // This file's share of the global histogram
+  struct watch_file *next;
+};
+
+// An inotify instance, the paths of its watches, and the table of
+// counted files.
+struct watch {
+  int fd;                  // inotify descriptor
+  char **wd_paths;         // Watched path for each watch descriptor
+  bool *wd_tree;           // Whether every file in it counts
+  int wd_cap;
+
+  struct watch_file **buckets;
+  size_t nbuckets;
+  pthread_mutex_t lock;    // Guards the file table
+};
+
+// Create the inotify instance.  Returns non-zero on error.
+int watch_init(struct watch *w);
+
+// Close the instance and free all state.
+void watch_destroy(struct watch *w);
+
+// Watch a directory for changes to the files in it.  'tree' says
+// whether every file in it counts, or only files named on the command
+// line (whose directories are watched so that a file replaced by a
+// rename is still seen).  A directory can be both, and then is a tree.
+// Returns the watch descriptor, or -1 on error.
+int watch_add(struct watch *w, const char *path, bool tree);
+
+// The path watched by 'wd', or NULL if unknown.
+const char *watch_path(const struct watch *w, int wd);
+
+// Whether every file in the directory watched by 'wd' counts.
+bool watch_is_tree(const struct watch *w, int wd);
+
+// Forget the path of a watch that inotify has dropped.
+void watch_remove(struct watch *w, int wd);
+
+// Find the entry for 'path', creating a zeroed one if 'create' is set.
+// Returns NULL if not found (or on allocation failure).  The entry
+// stays valid until it is removed.
+struct watch_file *watch_file_get(struct watch *w, const char *path, bool create);
+
+// Remove the entry for 'path', or, if 'prefix' is set, for every path
+// below the directory 'path'.  'forget' is called on each entry before
+// it is freed.
+void watch_file_remove(struct watch *w, const char *path, bool prefix,
+                       void (*forget)(struct watch_file *));
+
+// Fingerprint of the first 'offset' bytes of the open file 'fd', used
+// to tell an append from a rewrite.  Up to 64 KiB of them are hashed:
+// all of them in a small file, and otherwise 16 windows of 4 KiB
+// spread evenly from the start to the end.
+uint64_t watch_fingerprint(int fd, off_t offset);
+
+#endif